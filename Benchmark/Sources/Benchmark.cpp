@@ -0,0 +1,44 @@
+#include "pch.h"
+
+#include <Kore/Log.h>
+#include <string.h>
+
+#include "Benchmarks.h"
+#include "Memory.h"
+
+using namespace Kore;
+
+namespace {
+	struct Benchmark {
+		const char* name;
+		void (*run)();
+	};
+	
+	const Benchmark benchmarks[] = {
+		{ "obj", benchmarkObjLoader },
+		{ "simulation", benchmarkSimulation },
+		{ "network", benchmarkNetwork },
+		{ "entities", benchmarkEntities },
+		{ "collisions", benchmarkCollisions }
+	};
+	const int benchmarkCount = sizeof(benchmarks) / sizeof(benchmarks[0]);
+}
+
+// Runs the benchmarks named on the command line, or all of them
+int kore(int argc, char** argv) {
+	Memory::init(512 * 1024 * 1024);
+	
+	for (int i = 0; i < benchmarkCount; ++i) {
+		bool selected = argc <= 1;
+		for (int arg = 1; arg < argc; ++arg) {
+			if (strcmp(argv[arg], benchmarks[i].name) == 0) selected = true;
+		}
+		if (!selected) continue;
+		log(Info, "Running benchmark %s", benchmarks[i].name);
+		benchmarks[i].run();
+	}
+	
+	// the peaks of the benchmarked asset sets
+	Memory::report();
+	return 0;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+// Each benchmark logs its own results table
+void benchmarkObjLoader();
+void benchmarkSimulation();
+void benchmarkNetwork();
+void benchmarkEntities();
+void benchmarkCollisions();
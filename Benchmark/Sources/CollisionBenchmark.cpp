@@ -0,0 +1,80 @@
+#include "pch.h"
+
+#include <Kore/Log.h>
+#include <Kore/System.h>
+#include <math.h>
+
+#include "Benchmarks.h"
+#include "Collisions.h"
+#include "Memory.h"
+
+using namespace Kore;
+
+namespace {
+	const int ballCounts[] = { 1000, 10000, 100000 };
+	// The all pairs test takes too long above this
+	const int maxBruteForce = 10000;
+	const int repetitions = 20;
+	// Share of the playfield covered by balls, the radius shrinks as the count grows
+	const float coverage = 0.3f;
+	const int maxContacts = 1000000;
+	
+	float randomFloat(u32& state) {
+		state = state * 1664525u + 1013904223u;
+		return (state >> 8) * (1.0f / 16777216.0f);
+	}
+	
+	int bruteForce(const EntityState* balls, int count, float radius) {
+		int contacts = 0;
+		float diameter = radius * 2;
+		for (int i = 0; i < count; ++i) {
+			for (int j = i + 1; j < count; ++j) {
+				float dx = balls[j].x - balls[i].x, dy = balls[j].y - balls[i].y, dz = balls[j].z - balls[i].z;
+				if (dx * dx + dy * dy + dz * dz < diameter * diameter) ++contacts;
+			}
+		}
+		return contacts;
+	}
+}
+
+// Balls spread over the playfield at the same density for every count, the
+// time per ball should stay about the same while the all pairs test grows
+void benchmarkCollisions() {
+	log(Info, "%10s %10s %12s %12s %10s %14s %8s", "balls", "radius", "hash ms", "ns/ball", "contacts", "all pairs ms", "match");
+	for (int count : ballCounts) {
+		size_t marker = Memory::mark();
+		float radius = sqrtf(2 * 8 * coverage / (3.14159265f * count));
+		EntityState* balls = Memory::allocate<EntityState>(GeneralMemory, count);
+		int* ids = Memory::allocate<int>(GeneralMemory, count);
+		Contact* contacts = Memory::allocate<Contact>(GeneralMemory, maxContacts);
+		u32 random = 1;
+		for (int i = 0; i < count; ++i) {
+			balls[i].x = randomFloat(random) * 2 - 1;
+			balls[i].y = randomFloat(random) * 8 - 4;
+			balls[i].z = 0;
+			balls[i].rotation = Quaternion(0, 0, 0, 1);
+			ids[i] = i;
+		}
+		
+		Collisions collisions(radius);
+		int contactCount = 0;
+		double best = 1e9;
+		for (int i = 0; i < repetitions; ++i) {
+			double start = System::time();
+			contactCount = collisions.detect(balls, ids, count, contacts, maxContacts);
+			double time = System::time() - start;
+			if (time < best) best = time;
+		}
+		
+		if (count <= maxBruteForce) {
+			double start = System::time();
+			int expected = bruteForce(balls, count, radius);
+			double time = System::time() - start;
+			log(Info, "%10i %10.4f %12.3f %12.1f %10i %14.3f %8s", count, radius, best * 1000, best * 1e9 / count, contactCount, time * 1000, expected == contactCount ? "yes" : "NO");
+		}
+		else {
+			log(Info, "%10i %10.4f %12.3f %12.1f %10i %14s %8s", count, radius, best * 1000, best * 1e9 / count, contactCount, "-", "-");
+		}
+		Memory::release(marker);
+	}
+}
@@ -0,0 +1,132 @@
+#include "pch.h"
+
+#include <Kore/Log.h>
+#include <Kore/Math/Quaternion.h>
+#include <Kore/System.h>
+#include <math.h>
+
+#include "Benchmarks.h"
+#include "EntityStore.h"
+#include "Memory.h"
+#include "Simulation.h"
+
+using namespace Kore;
+
+namespace {
+	const int entityCounts[] = { 1000, 10000, 100000 };
+	// Entity updates per measurement, the same work for every count
+	const int updates = 20000000;
+	
+	// The way the game updates its objects: one heap object each, a virtual
+	// call per object and the model matrix from a Quaternion
+	class MovingObject {
+	public:
+		virtual ~MovingObject() {}
+		virtual void update(float tdif) = 0;
+		
+		mat4 M;
+	};
+	
+	class MovingBall : public MovingObject {
+	public:
+		MovingBall(const EntityState& state, const vec3& velocity, const Quaternion& spin) : position(state.x, state.y, state.z), velocity(velocity), rotation(state.rotation), spin(spin) {}
+		
+		void update(float tdif) override {
+			(void)tdif;
+			position += velocity;
+			if (position.x() < -1) position.x() = -1;
+			if (position.x() > 1) position.x() = 1;
+			if (position.y() < -4) position.y() = 4;
+			else if (position.y() > 4) position.y() = -4;
+			rotation = spin.rotated(rotation);
+			rotation.normalize();
+			M = mat4::Translation(position.x(), position.y(), position.z()) * rotation.matrix();
+		}
+	
+	private:
+		vec3 position;
+		vec3 velocity;
+		Quaternion rotation;
+		Quaternion spin;
+	};
+	
+	struct Random {
+		u32 state;
+		
+		float next() {
+			state = state * 1664525u + 1013904223u;
+			return (state >> 8) * (1.0f / 16777216.0f);
+		}
+	};
+	
+	// Somewhere on the playfield, rolling in some direction
+	void createEntity(Random& random, EntityState& state, vec3& velocity, Quaternion& spin) {
+		state.x = random.next() * 2 - 1;
+		state.y = random.next() * 8 - 4;
+		state.z = 0;
+		state.rotation = Quaternion(0, 0, 0, 1);
+		velocity = vec3(random.next() * 0.1f - 0.05f, random.next() * 0.1f - 0.05f, 0);
+		float angle = random.next() * 0.2f;
+		vec3 axis(random.next() - 0.5f, random.next() - 0.5f, random.next() - 0.5f);
+		axis.normalize();
+		spin = Quaternion(axis.x() * sinf(angle / 2), axis.y() * sinf(angle / 2), axis.z() * sinf(angle / 2), cosf(angle / 2));
+	}
+	
+	double runStore(EntityStore& store, mat4* matrices, int ticks) {
+		double start = System::time();
+		for (int tick = 0; tick < ticks; ++tick) {
+			store.tick();
+			store.buildMatrices(matrices);
+		}
+		return System::time() - start;
+	}
+}
+
+// Moves the same entities and builds their matrices through virtual calls,
+// through the entity store with scalar kernels and with SIMD kernels
+void benchmarkEntities() {
+	log(Info, "%10s %12s %12s %12s %10s %12s", "entities", "virtual ns", "scalar ns", "simd ns", "speedup", "difference");
+	for (int count : entityCounts) {
+		int ticks = updates / count;
+		size_t marker = Memory::mark();
+		EntityStore scalar(count);
+		EntityStore simd(count);
+		scalar.setSimd(false);
+		MovingObject** objects = new MovingObject*[count];
+		Random random = { 1 };
+		for (int i = 0; i < count; ++i) {
+			EntityState state;
+			vec3 velocity;
+			Quaternion spin;
+			createEntity(random, state, velocity, spin);
+			objects[i] = new MovingBall(state, velocity, spin);
+			scalar.add(state, velocity.x(), velocity.y(), velocity.z(), spin);
+			simd.add(state, velocity.x(), velocity.y(), velocity.z(), spin);
+		}
+		mat4* scalarMatrices = Memory::allocate<mat4>(GeneralMemory, count);
+		mat4* simdMatrices = Memory::allocate<mat4>(GeneralMemory, count);
+		
+		double start = System::time();
+		for (int tick = 0; tick < ticks; ++tick) {
+			for (int i = 0; i < count; ++i) objects[i]->update((float)tickTime);
+		}
+		double virtualTime = System::time() - start;
+		double scalarTime = runStore(scalar, scalarMatrices, ticks);
+		double simdTime = runStore(simd, simdMatrices, ticks);
+		
+		// both kernels round differently, the matrices should still agree closely
+		float difference = 0;
+		for (int i = 0; i < count; ++i) {
+			const float* a = &scalarMatrices[i].matrix[0][0];
+			const float* b = &simdMatrices[i].matrix[0][0];
+			for (int element = 0; element < 16; ++element) difference = fmaxf(difference, fabsf(a[element] - b[element]));
+		}
+		
+		double perEntity = 1e9 / ((double)ticks * count);
+		log(Info, "%10i %12.2f %12.2f %12.2f %10.2f %12g", count, virtualTime * perEntity, scalarTime * perEntity, simdTime * perEntity, virtualTime / simdTime, difference);
+		
+		for (int i = 0; i < count; ++i) delete objects[i];
+		delete[] objects;
+		Memory::release(marker);
+	}
+}
@@ -0,0 +1,79 @@
+#include "pch.h"
+
+#include "LinkSimulator.h"
+
+#include <string.h>
+
+using namespace Kore;
+
+LinkSimulator::LinkSimulator(const LinkConditions& conditions, u32 seed) : conditions(conditions), randomState(seed), count(0), busyUntil(0), lastArrival(0), packets(0), bytes(0) {}
+
+// xorshift32, in [0, 1)
+double LinkSimulator::random() {
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 17;
+	randomState ^= randomState << 5;
+	return (randomState >> 8) / 16777216.0;
+}
+
+void LinkSimulator::queue(const InFlight& flight, double arrival) {
+	InFlight* queued = pool.create(flight);
+	if (queued == nullptr) return;
+	queued->packet.time = arrival;
+	flights[count++] = queued;
+}
+
+void LinkSimulator::send(unsigned fromAddress, int fromPort, unsigned toAddress, int toPort, const u8* data, int size, double now) {
+	++packets;
+	bytes += size + headerSize;
+	
+	double departure = now;
+	if (conditions.bytesPerSecond > 0) {
+		departure = busyUntil > now ? busyUntil : now;
+		if (departure - now > maxQueueTime) return;
+		busyUntil = departure + (double)(size + headerSize) / conditions.bytesPerSecond;
+	}
+	if (random() < conditions.loss) return;
+	
+	InFlight flight;
+	memcpy(flight.packet.data, data, size);
+	flight.packet.size = size;
+	flight.packet.address = fromAddress;
+	flight.packet.port = fromPort;
+	flight.toAddress = toAddress;
+	flight.toPort = toPort;
+	
+	double arrival = departure + conditions.latency + conditions.jitter * random();
+	if (random() < conditions.reordering) {
+		arrival += 0.01 + 0.04 * random();
+	}
+	else {
+		if (arrival < lastArrival) arrival = lastArrival;
+		lastArrival = arrival;
+	}
+	queue(flight, arrival);
+	if (random() < conditions.duplication) queue(flight, arrival + conditions.jitter * random());
+}
+
+bool LinkSimulator::receive(double now, Packet& packet, unsigned& toAddress, int& toPort) {
+	int first = -1;
+	for (int i = 0; i < count; ++i) {
+		if (flights[i]->packet.time > now) continue;
+		if (first < 0 || flights[i]->packet.time < flights[first]->packet.time) first = i;
+	}
+	if (first < 0) return false;
+	packet = flights[first]->packet;
+	toAddress = flights[first]->toAddress;
+	toPort = flights[first]->toPort;
+	pool.destroy(flights[first]);
+	flights[first] = flights[--count];
+	return true;
+}
+
+int LinkSimulator::sentPackets() const {
+	return packets;
+}
+
+int LinkSimulator::sentBytes() const {
+	return bytes;
+}
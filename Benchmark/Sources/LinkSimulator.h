@@ -0,0 +1,64 @@
+#pragma once
+
+#include "Network.h"
+#include "Pool.h"
+
+struct LinkConditions {
+	// One way, in seconds
+	double latency;
+	// Every datagram gets up to this much extra delay, without overtaking earlier ones
+	double jitter;
+	// Chances per datagram
+	double loss;
+	double duplication;
+	// Held back 10 to 50 ms longer than the ones sent after it
+	double reordering;
+	// Including the udp and ip headers, 0 for unlimited
+	int bytesPerSecond;
+};
+
+// One direction of a network link between endpoints in the same process.
+// Datagrams come out of receive() once the simulated time passed their
+// arrival time. Random decisions come from a seeded generator, so every run
+// with the same traffic behaves the same.
+class LinkSimulator {
+public:
+	// Size of the udp and ip headers every datagram carries on the wire
+	static const int headerSize = 28;
+	
+	LinkSimulator(const LinkConditions& conditions, Kore::u32 seed = 1);
+	
+	void send(unsigned fromAddress, int fromPort, unsigned toAddress, int toPort, const Kore::u8* data, int size, double now);
+	// Next datagram that arrived by now in arrival order, the packet's address and port tell the sender
+	bool receive(double now, Packet& packet, unsigned& toAddress, int& toPort);
+	
+	// Everything that was sent, including what got lost
+	int sentPackets() const;
+	int sentBytes() const;
+
+private:
+	static const int capacity = 256;
+	// Datagrams waiting longer than this for the bandwidth are dropped, like a full router queue
+	static constexpr double maxQueueTime = 0.25;
+	
+	struct InFlight {
+		Packet packet;
+		unsigned toAddress;
+		int toPort;
+	};
+	
+	double random();
+	void queue(const InFlight& flight, double arrival);
+	
+	LinkConditions conditions;
+	Kore::u32 randomState;
+	Pool<InFlight, capacity> pool;
+	// In no particular order
+	InFlight* flights[capacity];
+	int count;
+	// The bandwidth is used up until then
+	double busyUntil;
+	double lastArrival;
+	int packets;
+	int bytes;
+};
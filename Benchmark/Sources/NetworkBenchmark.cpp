@@ -0,0 +1,192 @@
+#include "pch.h"
+
+#include <Kore/Log.h>
+#include <Kore/System.h>
+#include <algorithm>
+#include <math.h>
+
+#include "Benchmarks.h"
+#include "LinkSimulator.h"
+#include "Master.h"
+#include "Slave.h"
+
+using namespace Kore;
+
+namespace {
+	struct Condition {
+		const char* name;
+		LinkConditions link;
+	};
+	
+	// latency, jitter, loss, duplication, reordering, bytes per second
+	const Condition conditions[] = {
+		{ "lan", { 0.001, 0.001, 0, 0, 0, 0 } },
+		{ "broadband", { 0.02, 0.005, 0.01, 0, 0.01, 0 } },
+		{ "wifi", { 0.03, 0.03, 0.05, 0.02, 0.05, 0 } },
+		{ "mobile", { 0.08, 0.04, 0.1, 0.02, 0.05, 32000 } },
+		{ "congested", { 0.05, 0.01, 0.02, 0, 0, 12000 } },
+		{ "terrible", { 0.15, 0.05, 0.3, 0.05, 0.1, 16000 } }
+	};
+	
+	const int slaveCount = 4;
+	// Simulated seconds per link condition
+	const int duration = 30;
+	// Errors are only measured once the slaves joined and their buffers filled
+	const double warmup = 2.0;
+	
+	const unsigned address = 0x7f000001;
+	const int masterPort = 9898;
+	const int firstSlavePort = 10000;
+	
+	// Authoritative states of the first balls (the npc, the master's and the slaves') by tick
+	const int historySize = 256;
+	const int trackedBalls = 2 + slaveCount;
+	EntityState history[historySize][trackedBalls];
+	
+	const int maxErrors = duration * tickRate * slaveCount * trackedBalls;
+	float errors[maxErrors];
+	
+	LinkSimulator* downstream;
+	LinkSimulator* upstream;
+	// Port of the endpoint that is currently running, the link needs to know who sends
+	int sender;
+	double now;
+	
+	bool send(unsigned toAddress, int toPort, const u8* data, int size) {
+		LinkSimulator* link = sender == masterPort ? downstream : upstream;
+		link->send(address, sender, toAddress, toPort, data, size, now);
+		return true;
+	}
+	
+	// Every player changes its inputs every few ticks, the same way in every run
+	PlayerInput createInput(u32& state) {
+		state = state * 1664525u + 1013904223u;
+		u32 bits = state >> 24;
+		PlayerInput input;
+		input.left = (bits & 3) == 1;
+		input.right = (bits & 3) == 2;
+		input.up = ((bits >> 2) & 3) == 1;
+		input.down = ((bits >> 2) & 3) == 2;
+		return input;
+	}
+	
+	float distance(const EntityState& a, const EntityState& b) {
+		float dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+		return sqrtf(dx * dx + dy * dy + dz * dz);
+	}
+	
+	float percentile(int count, double fraction) {
+		if (count == 0) return 0;
+		float* nth = &errors[(int)(count * fraction)];
+		std::nth_element(errors, nth, errors + count);
+		return *nth;
+	}
+}
+
+// Runs a master and a few slaves in one process over simulated links, as
+// fast as the cpu allows, and compares what the slaves show of the balls
+// near their own with the master's state at the time they show it
+void benchmarkNetwork() {
+	log(Info, "%10s %9s %9s %10s %10s %10s %11s %10s %10s %10s", "link", "down B/s", "up B/s", "packets/s", "error avg", "error p95", "corrections", "rate", "master us", "slave us");
+	Network::setSendHandler(send);
+	for (const Condition& condition : conditions) {
+		downstream = new LinkSimulator(condition.link, 1);
+		upstream = new LinkSimulator(condition.link, 2);
+		
+		Simulation* masterSimulation = new Simulation;
+		sender = masterPort;
+		now = 0;
+		Master* master = new Master(*masterSimulation);
+		Simulation* slaveSimulations[slaveCount];
+		Slave* slaves[slaveCount];
+		u32 inputStates[slaveCount + 1];
+		PlayerInput inputs[slaveCount + 1];
+		for (int i = 0; i < slaveCount; ++i) {
+			slaveSimulations[i] = new Simulation;
+			slaves[i] = new Slave(*slaveSimulations[i]);
+			sender = firstSlavePort + i;
+			slaves[i]->connect(address, masterPort, now);
+		}
+		for (int i = 0; i <= slaveCount; ++i) inputStates[i] = i + 1;
+		
+		double masterTime = 0, slaveTime = 0;
+		double errorSum = 0;
+		int errorCount = 0;
+		int corrections = 0;
+		int ticks = duration * tickRate;
+		for (int tick = 0; tick < ticks; ++tick) {
+			now = tick * tickTime;
+			if (tick % 8 == 0) {
+				for (int i = 0; i <= slaveCount; ++i) inputs[i] = createInput(inputStates[i]);
+			}
+			
+			Packet packet;
+			unsigned toAddress;
+			int toPort;
+			double start = System::time();
+			sender = masterPort;
+			while (upstream->receive(now, packet, toAddress, toPort)) master->receive(packet);
+			master->update(now);
+			master->tick(inputs[slaveCount]);
+			u32 masterTick = masterSimulation->currentTick();
+			for (int i = 0; i < trackedBalls; ++i) history[masterTick % historySize][i] = masterSimulation->balls[i];
+			double middle = System::time();
+			masterTime += middle - start;
+			
+			while (downstream->receive(now, packet, toAddress, toPort)) {
+				sender = toPort;
+				slaves[toPort - firstSlavePort]->receive(packet);
+			}
+			for (int i = 0; i < slaveCount; ++i) {
+				sender = firstSlavePort + i;
+				slaves[i]->update(now);
+				slaves[i]->tick(inputs[i]);
+			}
+			slaveTime += System::time() - middle;
+			
+			if (now < warmup) continue;
+			for (int i = 0; i < slaveCount; ++i) {
+				// the master's state at the time the slave shows, between two ticks
+				double time = slaves[i]->remoteTime(now) / tickTime;
+				if (time < masterTick - historySize + 2) continue;
+				if (time > masterTick) time = masterTick;
+				int before = (int)floor(time);
+				int after = before < (int)masterTick ? before + 1 : before;
+				float t = (float)(time - before);
+				
+				int own = slaves[i]->ownBall();
+				if (own < 0 || own >= trackedBalls) continue;
+				EntityState center = interpolate(history[before % historySize][own], history[after % historySize][own], t);
+				
+				u16 ids[maxEntities];
+				EntityState states[maxEntities];
+				int count = slaves[i]->remoteBalls(now, ids, states, maxEntities);
+				for (int ball = 0; ball < count; ++ball) {
+					if (ids[ball] >= trackedBalls) continue;
+					EntityState truth = interpolate(history[before % historySize][ids[ball]], history[after % historySize][ids[ball]], t);
+					// the master does not send the others
+					if (distance(truth, center) > Master::interestRadius) continue;
+					float error = distance(truth, states[ball]);
+					errorSum += error;
+					if (errorCount < maxErrors) errors[errorCount++] = error;
+				}
+			}
+		}
+		
+		for (int i = 0; i < slaveCount; ++i) corrections += slaves[i]->takeStats().corrections;
+		NetworkStats masterStats = master->takeStats();
+		double packetsPerSecond = (downstream->sentPackets() + upstream->sentPackets()) / (double)duration / slaveCount;
+		log(Info, "%10s %9.0f %9.0f %10.1f %10.4f %10.4f %11i %10.1f %10.2f %10.2f", condition.name, downstream->sentBytes() / (double)duration / slaveCount, upstream->sentBytes() / (double)duration / slaveCount,
+			packetsPerSecond, errorCount > 0 ? errorSum / errorCount : 0.0, percentile(errorCount, 0.95), corrections, masterStats.sendRate, masterTime / ticks * 1000000.0, slaveTime / ticks / slaveCount * 1000000.0);
+		
+		for (int i = 0; i < slaveCount; ++i) {
+			delete slaves[i];
+			delete slaveSimulations[i];
+		}
+		delete master;
+		delete masterSimulation;
+		delete upstream;
+		delete downstream;
+	}
+	Network::setSendHandler(nullptr);
+}
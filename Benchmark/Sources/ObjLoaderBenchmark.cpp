@@ -0,0 +1,74 @@
+#include "pch.h"
+
+#include <Kore/Log.h>
+#include <Kore/Math/Core.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Benchmarks.h"
+#include "Memory.h"
+#include "ObjLoader.h"
+
+using namespace Kore;
+
+namespace {
+	const int lineCounts[] = { 20000, 200000, 1000000, 4000000 };
+	const int threadCounts[] = { 1, 2, 4, 8 };
+	const int repetitions = 3;
+	
+	// A uv sphere of size x size vertices written as quads with separate
+	// position/uv/normal indices, roughly 4 * size * size lines
+	char* createSphere(int size, int& length) {
+		size_t capacity = (size_t)size * size * 200;
+		char* text = (char*)malloc(capacity);
+		size_t used = 0;
+		for (int y = 0; y < size; ++y) {
+			for (int x = 0; x < size; ++x) {
+				float theta = pi * y / (size - 1);
+				float phi = 2.0f * pi * x / (size - 1);
+				float nx = sinf(theta) * cosf(phi);
+				float ny = cosf(theta);
+				float nz = sinf(theta) * sinf(phi);
+				used += snprintf(&text[used], capacity - used, "v %f %f %f\nvt %f %f\nvn %f %f %f\n", nx, ny, nz, x / (size - 1.0f), y / (size - 1.0f), nx, ny, nz);
+			}
+		}
+		for (int y = 0; y < size - 1; ++y) {
+			for (int x = 0; x < size - 1; ++x) {
+				int a = y * size + x + 1;
+				int b = a + 1;
+				int c = a + size + 1;
+				int d = a + size;
+				used += snprintf(&text[used], capacity - used, "f %i/%i/%i %i/%i/%i %i/%i/%i %i/%i/%i\n", a, a, a, b, b, b, c, c, c, d, d, d);
+			}
+		}
+		length = (int)used;
+		return text;
+	}
+}
+
+void benchmarkObjLoader() {
+	log(Info, "%10s %8s %12s %8s %12s", "lines", "threads", "parse ms", "speedup", "build ms");
+	for (int lineCount : lineCounts) {
+		int size = (int)sqrtf(lineCount / 4.0f);
+		int length;
+		char* source = createSphere(size, length);
+		
+		double singleThreaded = 0;
+		for (int threads : threadCounts) {
+			ObjLoadTimes best = { 1e9, 1e9 };
+			for (int i = 0; i < repetitions; ++i) {
+				size_t marker = Memory::mark();
+				ObjLoadTimes times;
+				parseObj("benchmark", source, length, threads, &times);
+				Memory::release(marker);
+				if (times.parse < best.parse) best.parse = times.parse;
+				if (times.build < best.build) best.build = times.build;
+			}
+			if (threads == 1) singleThreaded = best.parse;
+			log(Info, "%10i %8i %12.2f %8.2f %12.2f", 4 * size * size, threads, best.parse * 1000, singleThreaded / best.parse, best.build * 1000);
+		}
+		
+		free(source);
+	}
+}
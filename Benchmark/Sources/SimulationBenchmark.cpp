@@ -0,0 +1,62 @@
+#include "pch.h"
+
+#include <Kore/Log.h>
+#include <Kore/System.h>
+
+#include "Benchmarks.h"
+#include "Simulation.h"
+
+using namespace Kore;
+
+namespace {
+	const int tickCounts[] = { 3600, 36000, 360000 };
+	const int playerCount = 2;
+	
+	// Changes the inputs every few ticks, the same way for every run
+	void createInputs(u32& state, PlayerInput inputs[playerCount]) {
+		for (int i = 0; i < playerCount; ++i) {
+			state = state * 1664525u + 1013904223u;
+			u32 bits = state >> 24;
+			inputs[i].left = (bits & 3) == 1;
+			inputs[i].right = (bits & 3) == 2;
+			inputs[i].up = ((bits >> 2) & 3) == 1;
+			inputs[i].down = ((bits >> 2) & 3) == 2;
+		}
+	}
+	
+	void runTick(Simulation& simulation, const int players[playerCount], const PlayerInput inputs[playerCount]) {
+		simulation.beginTick();
+		for (int i = 0; i < playerCount; ++i) simulation.movePlayer(players[i], inputs[i]);
+		simulation.endTick();
+	}
+}
+
+// Runs two simulations headless with the same inputs and checks that they never diverge
+void benchmarkSimulation() {
+	log(Info, "%10s %12s %14s %12s %10s", "ticks", "ms", "ticks/second", "realtime x", "identical");
+	for (int tickCount : tickCounts) {
+		Simulation first;
+		Simulation second;
+		u32 inputState = 1;
+		PlayerInput inputs[playerCount];
+		int firstPlayers[playerCount];
+		int secondPlayers[playerCount];
+		for (int i = 0; i < playerCount; ++i) {
+			firstPlayers[i] = first.spawnPlayer();
+			secondPlayers[i] = second.spawnPlayer();
+		}
+		bool identical = true;
+		
+		double start = System::time();
+		for (int tick = 0; tick < tickCount; ++tick) {
+			if (tick % 8 == 0) createInputs(inputState, inputs);
+			runTick(first, firstPlayers, inputs);
+			runTick(second, secondPlayers, inputs);
+			if (first.checksum() != second.checksum()) identical = false;
+		}
+		// both simulations and checksums are included, so this is the cost of two
+		double time = (System::time() - start) / 2;
+		
+		log(Info, "%10i %12.2f %14.0f %12.0f %10s", tickCount, time * 1000.0, tickCount / time, tickCount * tickTime / time, identical ? "yes" : "NO");
+	}
+}
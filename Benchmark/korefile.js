@@ -0,0 +1,14 @@
+let project = new Project('Exercise11-Benchmark', __dirname);
+
+project.addFile('../Sources/**');
+project.addFile('Sources/**');
+project.addIncludeDir('../Sources');
+project.setDebugDir('../Deployment');
+project.cpp11 = true;
+
+project.addDefine('BENCHMARK');
+
+Project.createProject('../Kore', __dirname).then((kore) => {
+	project.addSubProject(kore);
+	resolve(project);
+});
@@ -0,0 +1,15 @@
+let project = new Project('Exercise11-HeadlessServer', __dirname);
+
+project.addFile('../Sources/**');
+project.setDebugDir('../Deployment');
+project.cpp11 = true;
+
+// no window, graphics or input, see Sources/HeadlessMaster.cpp. Kore still
+// links its graphics backend here, "make headless" in Deployment builds without.
+project.addDefine('MASTER');
+project.addDefine('HEADLESS');
+
+Project.createProject('../Kore', __dirname).then((kore) => {
+	project.addSubProject(kore);
+	resolve(project);
+});
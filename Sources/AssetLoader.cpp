@@ -0,0 +1,133 @@
+#include "pch.h"
+
+// Decodes images and meshes for Assets, which the headless master does without
+#ifndef HEADLESS
+
+#include "AssetLoader.h"
+#include "Assets.h"
+#include "MeshCache.h"
+
+#include <Kore/Threads/Thread.h>
+#include <assert.h>
+
+using namespace Kore;
+
+namespace {
+	const int maxRequests = 64;
+	const int maxThreads = 8;
+	
+	AssetRequest requests[maxRequests];
+	// Requests below submitted are fully written, workers claim them by advancing claimed
+	std::atomic<int> submitted(0);
+	std::atomic<int> claimed(0);
+	int finished = 0;
+	
+	Thread* threads[maxThreads];
+	int threadCount = 0;
+	std::atomic<bool> running(false);
+	
+	void load(AssetRequest& request) {
+		if (request.type == AssetRequest::MeshType) {
+			request.mesh = loadMesh(request.filename);
+		}
+		else {
+			request.image = new Graphics1::Image(request.filename, true);
+		}
+	}
+	
+	bool claimRequest(int& index) {
+		index = claimed.load();
+		while (index < submitted.load()) {
+			if (claimed.compare_exchange_weak(index, index + 1)) return true;
+		}
+		return false;
+	}
+	
+	void work(void*) {
+		while (running.load()) {
+			int index;
+			if (!claimRequest(index)) {
+				threadSleep(1);
+				continue;
+			}
+			AssetRequest& request = requests[index];
+			request.state.store(AssetRequest::Loading);
+			load(request);
+			request.state.store(AssetRequest::Loaded);
+		}
+	}
+	
+	AssetRequest* queue(AssetRequest::Type type, const char* filename, AssetCallback callback, void* userData) {
+		int index = submitted.load();
+		assert(index < maxRequests);
+		AssetRequest& request = requests[index];
+		request.type = type;
+		request.filename = filename;
+		request.callback = callback;
+		request.userData = userData;
+		request.mesh = nullptr;
+		request.image = nullptr;
+		request.state.store(AssetRequest::Queued);
+		submitted.store(index + 1);
+		return &request;
+	}
+}
+
+void AssetLoader::init(int count) {
+	assert(count <= maxThreads);
+	running.store(true);
+	threadCount = count;
+	for (int i = 0; i < threadCount; ++i) {
+		threads[i] = createAndStartThread(work, nullptr);
+	}
+}
+
+void AssetLoader::shutdown() {
+	waitForAll();
+	running.store(false);
+	for (int i = 0; i < threadCount; ++i) {
+		waitForThreadStopThenFree(threads[i]);
+	}
+	threadCount = 0;
+}
+
+AssetRequest* AssetLoader::loadMesh(const char* filename, AssetCallback callback, void* userData) {
+	return queue(AssetRequest::MeshType, filename, callback, userData);
+}
+
+AssetRequest* AssetLoader::loadImage(const char* filename, AssetCallback callback, void* userData) {
+	return queue(AssetRequest::ImageType, filename, callback, userData);
+}
+
+bool AssetLoader::update() {
+	// Without workers everything is loaded right here
+	int index;
+	while (threadCount == 0 && claimRequest(index)) {
+		load(requests[index]);
+		requests[index].state.store(AssetRequest::Loaded);
+	}
+	
+	int count = submitted.load();
+	for (int i = finished; i < count; ++i) {
+		AssetRequest& request = requests[i];
+		if (request.state.load() != AssetRequest::Loaded) continue;
+		if (request.type == AssetRequest::MeshType) {
+			Assets::provideMesh(request.filename, request.mesh);
+		}
+		else {
+			Assets::provideImage(request.filename, request.image);
+		}
+		request.state.store(AssetRequest::Ready);
+		if (request.callback != nullptr) request.callback(&request, request.userData);
+	}
+	while (finished < count && requests[finished].ready()) ++finished;
+	return finished == count;
+}
+
+void AssetLoader::waitForAll() {
+	while (!update()) {
+		threadSleep(1);
+	}
+}
+
+#endif // HEADLESS
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Kore/Graphics1/Image.h>
+#include <atomic>
+#include "ObjLoader.h"
+
+struct AssetRequest;
+
+typedef void (*AssetCallback)(AssetRequest* request, void* userData);
+
+// Completion handle of a queued load, poll ready() or pass a callback
+struct AssetRequest {
+	enum Type {
+		MeshType,
+		ImageType
+	};
+	
+	enum State {
+		Queued,
+		Loading,
+		Loaded,	// CPU work done, waiting for AssetLoader::update
+		Ready	// Handed to the Assets registry, the callback runs right after
+	};
+	
+	Type type;
+	const char* filename;
+	AssetCallback callback;
+	void* userData;
+	std::atomic<int> state;
+	
+	Mesh* mesh;
+	Kore::Graphics1::Image* image;
+	
+	bool ready() const {
+		return state.load() == Ready;
+	}
+};
+
+// Reads, parses and decodes assets on worker threads. Everything that touches
+// the GPU or the Assets registry happens in update() on the calling thread.
+namespace AssetLoader {
+	void init(int threadCount = 2);
+	void shutdown();
+	
+	AssetRequest* loadMesh(const char* filename, AssetCallback callback = nullptr, void* userData = nullptr);
+	AssetRequest* loadImage(const char* filename, AssetCallback callback = nullptr, void* userData = nullptr);
+	
+	// Registers finished loads and runs their callbacks, returns true once nothing is pending
+	bool update();
+	void waitForAll();
+}
@@ -0,0 +1,207 @@
+#include "pch.h"
+
+// Textures and vertex buffers live on the gpu, the headless master has neither
+#ifndef HEADLESS
+
+#include "Assets.h"
+#include "MeshCache.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+using namespace Kore;
+
+namespace {
+	const int maxAssets = 64;
+	const int maxNameLength = 256;
+	
+	// Parsed meshes live in Memory (or a cache mapping) and are kept for the
+	// whole run, so a mesh that is acquired again later is not parsed twice
+	struct MeshData {
+		char name[maxNameLength];
+		Mesh* mesh;
+	};
+	
+	struct MeshEntry {
+		char name[maxNameLength];
+		int references;
+		MeshAsset asset;
+	};
+	
+	// Decoded images waiting for their texture upload
+	struct ImageData {
+		char name[maxNameLength];
+		Graphics1::Image* image;
+	};
+	
+	struct TextureEntry {
+		char name[maxNameLength];
+		int references;
+		TextureAsset asset;
+	};
+	
+	MeshData meshData[maxAssets];
+	int meshDataCount = 0;
+	ImageData images[maxAssets];
+	int imageCount = 0;
+	MeshEntry meshes[maxAssets];
+	TextureEntry textures[maxAssets];
+	
+	Mesh* findMesh(const char* filename) {
+		for (int i = 0; i < meshDataCount; ++i) {
+			if (strcmp(meshData[i].name, filename) == 0) return meshData[i].mesh;
+		}
+		return nullptr;
+	}
+	
+	void addMesh(const char* filename, Mesh* mesh) {
+		assert(meshDataCount < maxAssets);
+		MeshData& data = meshData[meshDataCount++];
+		strncpy(data.name, filename, maxNameLength - 1);
+		data.name[maxNameLength - 1] = 0;
+		data.mesh = mesh;
+	}
+	
+	Mesh* getMesh(const char* filename) {
+		Mesh* mesh = findMesh(filename);
+		if (mesh == nullptr) {
+			mesh = loadMesh(filename);
+			addMesh(filename, mesh);
+		}
+		return mesh;
+	}
+	
+	// Returns the texture of a provided image, nullptr if there is none
+	Graphics4::Texture* uploadImage(const char* filename) {
+		for (int i = 0; i < imageCount; ++i) {
+			if (strcmp(images[i].name, filename) != 0) continue;
+			
+			Graphics1::Image* image = images[i].image;
+			images[i] = images[--imageCount];
+			
+			Graphics4::Texture* texture = new Graphics4::Texture(image->width, image->height, image->format, true);
+			u8* pixels = texture->lock();
+			int stride = texture->stride();
+			int rowSize = image->width * Graphics1::Image::sizeOf(image->format);
+			for (int y = 0; y < image->height; ++y) {
+				memcpy(&pixels[y * stride], &image->data[y * rowSize], rowSize);
+			}
+			texture->unlock();
+			delete image;
+			return texture;
+		}
+		return nullptr;
+	}
+	
+	void createBuffers(MeshAsset& asset, const Graphics4::VertexStructure& structure) {
+		Mesh* mesh = asset.mesh;
+		float scale = asset.scale;
+		
+		asset.minx = mesh->minx * scale;
+		asset.miny = mesh->miny * scale;
+		asset.minz = mesh->minz * scale;
+		asset.maxx = mesh->maxx * scale;
+		asset.maxy = mesh->maxy * scale;
+		asset.maxz = mesh->maxz * scale;
+		
+		// The mesh is already in the layout of the vertex buffer
+		asset.vertexBuffer = new Graphics4::VertexBuffer(mesh->numVertices, structure, 0);
+		float* vertices = asset.vertexBuffer->lock();
+		memcpy(vertices, mesh->vertices, mesh->numVertices * 8 * sizeof(float));
+		if (scale != 1.0f) {
+			for (int i = 0; i < mesh->numVertices; ++i) {
+				vertices[i * 8 + 0] *= scale;
+				vertices[i * 8 + 1] *= scale;
+				vertices[i * 8 + 2] *= scale;
+			}
+		}
+		asset.vertexBuffer->unlock();
+		
+		asset.indexBuffer = new Graphics4::IndexBuffer(mesh->numFaces * 3);
+		int* indices = asset.indexBuffer->lock();
+		memcpy(indices, mesh->indices, mesh->numFaces * 3 * sizeof(int));
+		asset.indexBuffer->unlock();
+	}
+}
+
+MeshAsset* Assets::acquireMesh(const char* filename, const Graphics4::VertexStructure& structure, float scale) {
+	MeshEntry* free = nullptr;
+	for (int i = 0; i < maxAssets; ++i) {
+		MeshEntry& entry = meshes[i];
+		if (entry.references == 0) {
+			if (free == nullptr) free = &entry;
+			continue;
+		}
+		if (entry.asset.scale == scale && strcmp(entry.name, filename) == 0) {
+			++entry.references;
+			return &entry.asset;
+		}
+	}
+	
+	assert(free != nullptr);
+	strncpy(free->name, filename, maxNameLength - 1);
+	free->name[maxNameLength - 1] = 0;
+	free->references = 1;
+	free->asset.id = (int)(free - meshes);
+	free->asset.mesh = getMesh(filename);
+	free->asset.scale = scale;
+	createBuffers(free->asset, structure);
+	return &free->asset;
+}
+
+void Assets::release(MeshAsset* mesh) {
+	MeshEntry* entry = (MeshEntry*)((u8*)mesh - offsetof(MeshEntry, asset));
+	assert(entry->references > 0);
+	if (--entry->references > 0) return;
+	delete mesh->vertexBuffer;
+	delete mesh->indexBuffer;
+	mesh->vertexBuffer = nullptr;
+	mesh->indexBuffer = nullptr;
+}
+
+TextureAsset* Assets::acquireTexture(const char* filename) {
+	TextureEntry* free = nullptr;
+	for (int i = 0; i < maxAssets; ++i) {
+		TextureEntry& entry = textures[i];
+		if (entry.references == 0) {
+			if (free == nullptr) free = &entry;
+			continue;
+		}
+		if (strcmp(entry.name, filename) == 0) {
+			++entry.references;
+			return &entry.asset;
+		}
+	}
+	
+	assert(free != nullptr);
+	strncpy(free->name, filename, maxNameLength - 1);
+	free->name[maxNameLength - 1] = 0;
+	free->references = 1;
+	free->asset.id = (int)(free - textures);
+	free->asset.texture = uploadImage(filename);
+	if (free->asset.texture == nullptr) free->asset.texture = new Graphics4::Texture(filename, true);
+	return &free->asset;
+}
+
+void Assets::release(TextureAsset* texture) {
+	TextureEntry* entry = (TextureEntry*)((u8*)texture - offsetof(TextureEntry, asset));
+	assert(entry->references > 0);
+	if (--entry->references > 0) return;
+	delete texture->texture;
+	texture->texture = nullptr;
+}
+
+void Assets::provideMesh(const char* filename, Mesh* mesh) {
+	if (findMesh(filename) == nullptr) addMesh(filename, mesh);
+}
+
+void Assets::provideImage(const char* filename, Graphics1::Image* image) {
+	assert(imageCount < maxAssets);
+	ImageData& data = images[imageCount++];
+	strncpy(data.name, filename, maxNameLength - 1);
+	data.name[maxNameLength - 1] = 0;
+	data.image = image;
+}
+
+#endif // HEADLESS
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <Kore/Graphics1/Image.h>
+#include <Kore/Graphics4/Graphics.h>
+#include "ObjLoader.h"
+
+// GPU buffers of one mesh file at one scale, shared by every MeshObject using it
+struct MeshAsset {
+	// Index in the registry, orders draws by mesh
+	int id;
+	Mesh* mesh;
+	Kore::Graphics4::VertexBuffer* vertexBuffer;
+	Kore::Graphics4::IndexBuffer* indexBuffer;
+	float scale;
+	
+	// Bounds of the scaled mesh
+	float minx, miny, minz;
+	float maxx, maxy, maxz;
+};
+
+struct TextureAsset {
+	int id;
+	Kore::Graphics4::Texture* texture;
+};
+
+// Reference counted registry, every acquire has to be paired with a release.
+// Meshes are keyed by file name and scale (all users are expected to share one
+// vertex structure), textures by file name.
+namespace Assets {
+	MeshAsset* acquireMesh(const char* filename, const Kore::Graphics4::VertexStructure& structure, float scale = 1.0f);
+	void release(MeshAsset* mesh);
+	
+	TextureAsset* acquireTexture(const char* filename);
+	void release(TextureAsset* texture);
+	
+	// CPU side data loaded elsewhere (see AssetLoader), used by the next acquire of that file.
+	// The registry takes ownership of the image and uploads it on the acquiring thread.
+	void provideMesh(const char* filename, Mesh* mesh);
+	void provideImage(const char* filename, Kore::Graphics1::Image* image);
+}
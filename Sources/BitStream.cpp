@@ -0,0 +1,74 @@
+#include "pch.h"
+
+#include "BitStream.h"
+
+#include <assert.h>
+
+using namespace Kore;
+
+BitWriter::BitWriter(u8* data, int capacity) : data(data), capacity(capacity), bitIndex(0), overflow(false) {}
+
+void BitWriter::write(u32 value, int bits) {
+	assert(bits > 0 && bits <= 32);
+	if (bitIndex + bits > capacity * 8) {
+		overflow = true;
+		return;
+	}
+	while (bits > 0) {
+		int byte = bitIndex >> 3;
+		int offset = bitIndex & 7;
+		int count = 8 - offset < bits ? 8 - offset : bits;
+		u32 mask = (1u << count) - 1;
+		data[byte] = (u8)((data[byte] & ((1u << offset) - 1)) | ((value & mask) << offset));
+		value >>= count;
+		bits -= count;
+		bitIndex += count;
+	}
+}
+
+void BitWriter::writeBool(bool value) {
+	write(value ? 1 : 0, 1);
+}
+
+int BitWriter::bytes() const {
+	return (bitIndex + 7) >> 3;
+}
+
+int BitWriter::bits() const {
+	return bitIndex;
+}
+
+bool BitWriter::overflowed() const {
+	return overflow;
+}
+
+BitReader::BitReader(const u8* data, int size) : data(data), size(size), bitIndex(0), overflow(false) {}
+
+u32 BitReader::read(int bits) {
+	assert(bits > 0 && bits <= 32);
+	if (bitIndex + bits > size * 8) {
+		overflow = true;
+		return 0;
+	}
+	u32 value = 0;
+	int shift = 0;
+	while (bits > 0) {
+		int byte = bitIndex >> 3;
+		int offset = bitIndex & 7;
+		int count = 8 - offset < bits ? 8 - offset : bits;
+		u32 mask = (1u << count) - 1;
+		value |= ((data[byte] >> offset) & mask) << shift;
+		shift += count;
+		bits -= count;
+		bitIndex += count;
+	}
+	return value;
+}
+
+bool BitReader::readBool() {
+	return read(1) != 0;
+}
+
+bool BitReader::overflowed() const {
+	return overflow;
+}
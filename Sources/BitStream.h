@@ -0,0 +1,40 @@
+#pragma once
+
+#include <Kore/pch.h>
+
+// Packs values with an arbitrary number of bits (up to 32) into bytes, lowest bits first
+class BitWriter {
+public:
+	BitWriter(Kore::u8* data, int capacity);
+	
+	void write(Kore::u32 value, int bits);
+	void writeBool(bool value);
+	
+	// Bytes used so far, including a partially filled last byte
+	int bytes() const;
+	int bits() const;
+	bool overflowed() const;
+
+private:
+	Kore::u8* data;
+	int capacity;
+	int bitIndex;
+	bool overflow;
+};
+
+// Reads what a BitWriter wrote, reading past the end returns zeros and sets overflowed()
+class BitReader {
+public:
+	BitReader(const Kore::u8* data, int size);
+	
+	Kore::u32 read(int bits);
+	bool readBool();
+	
+	bool overflowed() const;
+
+private:
+	const Kore::u8* data;
+	int size;
+	int bitIndex;
+	bool overflow;
+};
@@ -0,0 +1,94 @@
+#include "pch.h"
+
+#include "BoundingVolumeHierarchy.h"
+
+#include <algorithm>
+#include <assert.h>
+
+using namespace Kore;
+
+namespace {
+	struct ByCenter {
+		const Aabb* bounds;
+		int axis;
+		
+		bool operator()(int a, int b) const {
+			return bounds[a].center(axis) < bounds[b].center(axis);
+		}
+	};
+}
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy() : itemBounds(nullptr), itemCount(0), nodeCount(0) {}
+
+void BoundingVolumeHierarchy::build(const Aabb* bounds, int count) {
+	assert(count <= maxItems);
+	itemBounds = bounds;
+	itemCount = count;
+	for (int i = 0; i < count; ++i) items[i] = i;
+	nodeCount = 0;
+	if (count == 0) return;
+	nodeCount = 1;
+	split(0, 0, count);
+}
+
+// Median split along the longest axis of the item centers, the tree stays balanced
+void BoundingVolumeHierarchy::split(int node, int first, int count) {
+	Aabb bounds = itemBounds[items[first]];
+	Aabb centers;
+	for (int axis = 0; axis < 3; ++axis) centers.min[axis] = centers.max[axis] = bounds.center(axis);
+	for (int i = first + 1; i < first + count; ++i) {
+		const Aabb& item = itemBounds[items[i]];
+		for (int axis = 0; axis < 3; ++axis) {
+			bounds.min[axis] = std::min(bounds.min[axis], item.min[axis]);
+			bounds.max[axis] = std::max(bounds.max[axis], item.max[axis]);
+			centers.min[axis] = std::min(centers.min[axis], item.center(axis));
+			centers.max[axis] = std::max(centers.max[axis], item.center(axis));
+		}
+	}
+	nodes[node].bounds = bounds;
+	nodes[node].first = first;
+	nodes[node].count = count;
+	nodes[node].left = -1;
+	if (count <= leafSize) return;
+	
+	ByCenter order;
+	order.bounds = itemBounds;
+	order.axis = 0;
+	for (int axis = 1; axis < 3; ++axis) {
+		if (centers.max[axis] - centers.min[axis] > centers.max[order.axis] - centers.min[order.axis]) order.axis = axis;
+	}
+	int half = count / 2;
+	std::nth_element(&items[first], &items[first + half], &items[first + count], order);
+	
+	int left = nodeCount;
+	nodeCount += 2;
+	nodes[node].left = left;
+	split(left, first, half);
+	split(left + 1, first + half, count - half);
+}
+
+int BoundingVolumeHierarchy::cull(const Frustum& frustum, int* visible, int capacity) const {
+	if (nodeCount == 0) return 0;
+	// a balanced tree over maxItems is far less deep
+	int stack[64];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	int count = 0;
+	while (stackSize > 0) {
+		const Node& node = nodes[stack[--stackSize]];
+		Frustum::Result result = frustum.test(node.bounds);
+		if (result == Frustum::Outside) continue;
+		if (result == Frustum::Intersecting && node.left >= 0) {
+			stack[stackSize++] = node.left;
+			stack[stackSize++] = node.left + 1;
+			continue;
+		}
+		// the items of a node completely inside are taken without testing them
+		for (int i = node.first; i < node.first + node.count; ++i) {
+			if (result == Frustum::Intersecting && frustum.test(itemBounds[items[i]]) == Frustum::Outside) continue;
+			if (count == capacity) return count;
+			visible[count++] = items[i];
+		}
+	}
+	return count;
+}
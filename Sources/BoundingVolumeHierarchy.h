@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Frustum.h"
+
+// Binary tree of boxes over the bounds of the objects of a frame, rebuilt
+// from scratch every frame because most objects move. Culling only visits
+// the nodes cut by the frustum, nodes completely inside it are taken whole.
+class BoundingVolumeHierarchy {
+public:
+	static const int maxItems = 1024;
+	
+	BoundingVolumeHierarchy();
+	
+	// Items are known by their index in bounds
+	void build(const Aabb* bounds, int count);
+	
+	// Writes the indices of the items the frustum sees, returns how many
+	int cull(const Frustum& frustum, int* visible, int capacity) const;
+
+private:
+	// Leaves hold up to this many items
+	static const int leafSize = 4;
+	
+	struct Node {
+		Aabb bounds;
+		// The items below the node are items[first] to items[first + count - 1]
+		int first;
+		int count;
+		// -1 for leaves, the right child follows the left one
+		int left;
+	};
+	
+	void split(int node, int first, int count);
+	
+	const Aabb* itemBounds;
+	int items[maxItems];
+	int itemCount;
+	Node nodes[2 * maxItems];
+	int nodeCount;
+};
@@ -0,0 +1,109 @@
+#include "pch.h"
+
+#include "Collisions.h"
+
+#include <math.h>
+#include "Memory.h"
+#include "ObjLoader.h"
+
+using namespace Kore;
+
+namespace {
+	unsigned hashCell(int x, int y) {
+		return (unsigned)x * 73856093u ^ (unsigned)y * 19349663u;
+	}
+}
+
+float sphereRadius(const Mesh* mesh, float scale) {
+	float extent = mesh->maxx - mesh->minx;
+	if (mesh->maxy - mesh->miny > extent) extent = mesh->maxy - mesh->miny;
+	if (mesh->maxz - mesh->minz > extent) extent = mesh->maxz - mesh->minz;
+	return extent * 0.5f * scale;
+}
+
+Collisions::Collisions(float radius) : ballRadius(radius), reserved(0), tableSize(0) {}
+
+void Collisions::setRadius(float radius) {
+	ballRadius = radius;
+}
+
+float Collisions::radius() const {
+	return ballRadius;
+}
+
+void Collisions::reserve(int count) {
+	if (count <= reserved) return;
+	reserved = count;
+	tableSize = 1;
+	while (tableSize < count * 2) tableSize *= 2;
+	bucketStart = Memory::allocate<int>(GeneralMemory, tableSize + 1);
+	bucketEnd = Memory::allocate<int>(GeneralMemory, tableSize);
+	buckets = Memory::allocate<int>(GeneralMemory, count);
+	entries = Memory::allocate<int>(GeneralMemory, count);
+	cellX = Memory::allocate<int>(GeneralMemory, count);
+	cellY = Memory::allocate<int>(GeneralMemory, count);
+	x = Memory::allocate<float>(GeneralMemory, count);
+	y = Memory::allocate<float>(GeneralMemory, count);
+	z = Memory::allocate<float>(GeneralMemory, count);
+}
+
+int Collisions::detect(const EntityState* balls, const int* ids, int count, Contact* contacts, int capacity) {
+	reserve(count);
+	float diameter = ballRadius * 2;
+	float scale = 1.0f / diameter;
+	unsigned mask = (unsigned)tableSize - 1;
+	
+	// counting sort by bucket, bucketStart first holds the counts
+	for (int i = 0; i <= tableSize; ++i) bucketStart[i] = 0;
+	for (int i = 0; i < count; ++i) {
+		const EntityState& ball = balls[ids[i]];
+		buckets[i] = (int)(hashCell((int)floorf(ball.x * scale), (int)floorf(ball.y * scale)) & mask);
+		++bucketStart[buckets[i] + 1];
+	}
+	for (int i = 0; i < tableSize; ++i) bucketStart[i + 1] += bucketStart[i];
+	for (int i = 0; i < tableSize; ++i) bucketEnd[i] = bucketStart[i];
+	for (int i = 0; i < count; ++i) {
+		const EntityState& ball = balls[ids[i]];
+		int index = bucketEnd[buckets[i]]++;
+		entries[index] = ids[i];
+		cellX[index] = (int)floorf(ball.x * scale);
+		cellY[index] = (int)floorf(ball.y * scale);
+		x[index] = ball.x;
+		y[index] = ball.y;
+		z[index] = ball.z;
+	}
+	
+	int contactCount = 0;
+	for (int i = 0; i < count; ++i) {
+		for (int dy = -1; dy <= 1; ++dy) {
+			for (int dx = -1; dx <= 1; ++dx) {
+				int column = cellX[i] + dx, row = cellY[i] + dy;
+				unsigned bucket = hashCell(column, row) & mask;
+				for (int j = bucketStart[bucket]; j < bucketStart[bucket + 1]; ++j) {
+					// every pair once, and only the balls of this cell when several share the bucket
+					if (j <= i || cellX[j] != column || cellY[j] != row) continue;
+					float ox = x[j] - x[i], oy = y[j] - y[i], oz = z[j] - z[i];
+					float distanceSquared = ox * ox + oy * oy + oz * oz;
+					if (distanceSquared >= diameter * diameter) continue;
+					if (contactCount == capacity) return contactCount;
+					
+					Contact& contact = contacts[contactCount++];
+					contact.a = entries[i];
+					contact.b = entries[j];
+					float distance = sqrtf(distanceSquared);
+					contact.depth = diameter - distance;
+					if (distance > 0) {
+						contact.nx = ox / distance;
+						contact.ny = oy / distance;
+						contact.nz = oz / distance;
+					}
+					else {
+						contact.nx = contact.nz = 0;
+						contact.ny = 1;
+					}
+				}
+			}
+		}
+	}
+	return contactCount;
+}
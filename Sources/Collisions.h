@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Snapshot.h"
+
+struct Mesh;
+
+// ball.obj is drawn and collides at this scale
+const float ballScale = 0.25f;
+
+// Balls collide as spheres around the bounds of their mesh
+float sphereRadius(const Mesh* mesh, float scale);
+
+// Two balls closer than two radii, the normal points from a to b
+struct Contact {
+	int a, b;
+	float depth;
+	float nx, ny, nz;
+};
+
+// Spatial hash broadphase and sphere tests for balls of one radius. Cells are
+// a ball diameter wide, so touching balls are at most one cell apart and each
+// ball is only tested against the balls of its own and the eight surrounding
+// cells. Cell coordinates are hashed into a table with twice as many buckets
+// as balls, which keeps the work linear in the ball count.
+class Collisions {
+public:
+	Collisions(float radius = 0.1f);
+	
+	void setRadius(float radius);
+	float radius() const;
+	
+	// Takes the arrays for up to count balls from the main allocator, which
+	// never gets them back. Does nothing when they are large enough already.
+	void reserve(int count);
+	
+	// Every overlapping pair among balls[ids[0]] to balls[ids[count - 1]], returns
+	// how many contacts were written. Reserves room for count balls first.
+	int detect(const EntityState* balls, const int* ids, int count, Contact* contacts, int capacity);
+
+private:
+	float ballRadius;
+	int reserved;
+	int tableSize;
+	// Balls sorted by bucket, the balls of bucket i are entries[bucketStart[i]] to entries[bucketStart[i + 1] - 1]
+	int* bucketStart;
+	int* bucketEnd;
+	// Bucket of every ball in the order of ids
+	int* buckets;
+	int* entries;
+	int* cellX;
+	int* cellY;
+	float* x;
+	float* y;
+	float* z;
+};
@@ -0,0 +1,261 @@
+#include "pch.h"
+
+#include "Connection.h"
+#include "Sequence.h"
+
+#include <assert.h>
+#include <string.h>
+
+using namespace Kore;
+
+namespace {
+	// sequence, ack, ack bits, flags
+	const int headerSize = 2 + 2 + 4 + 1;
+	const int reliableHeaderSize = headerSize + 2;
+	
+	const u8 ackOnlyFlag = 0;
+	const u8 unreliableFlag = 1;
+	const u8 reliableFlag = 2;
+	const u8 hasAckFlag = 0x80;
+	
+	// Without acks datagrams are still sent this often so the other side gets its acks
+	const double heartbeatInterval = 0.1;
+	
+	void writeU16(u8* data, u16 value) {
+		data[0] = (u8)(value & 0xff);
+		data[1] = (u8)(value >> 8);
+	}
+	
+	u16 readU16(const u8* data) {
+		return (u16)(data[0] | (data[1] << 8));
+	}
+	
+	void writeU32(u8* data, u32 value) {
+		writeU16(data, (u16)(value & 0xffff));
+		writeU16(&data[2], (u16)(value >> 16));
+	}
+	
+	u32 readU32(const u8* data) {
+		return readU16(data) | ((u32)readU16(&data[2]) << 16);
+	}
+}
+
+Connection::Connection() : address(0), port(0), now(0), lastSend(0), localSequence(0), unjudgedSequence(0), anyReceived(false), remoteSequence(0), receivedBits(0),
+	anyUnreliable(false), newestUnreliable(0), nextReliableId(0), expectedReliableId(0), deliveryCount(0), deliveryIndex(0), ackedHead(0), ackedTail(0), rtt(0.1), loss(0), resent(0) {
+	for (int i = 0; i < sentSize; ++i) {
+		sent[i].acked = true;
+		sent[i].message = -1;
+	}
+	for (int i = 0; i < reliableWindow; ++i) {
+		outgoing[i].used = false;
+		incoming[i].used = false;
+	}
+}
+
+void Connection::init(unsigned address, int port) {
+	this->address = address;
+	this->port = port;
+}
+
+u16 Connection::send(int flags, int message, const u8* data, int size) {
+	u8 buffer[Packet::maxSize];
+	int header = message >= 0 ? reliableHeaderSize : headerSize;
+	assert(header + size <= Packet::maxSize);
+	
+	u16 sequence = localSequence++;
+	writeU16(&buffer[0], sequence);
+	writeU16(&buffer[2], remoteSequence);
+	writeU32(&buffer[4], receivedBits);
+	buffer[8] = (u8)(flags | (anyReceived ? hasAckFlag : 0));
+	if (message >= 0) writeU16(&buffer[9], (u16)message);
+	if (size > 0) memcpy(&buffer[header], data, size);
+	
+	SentPacket& packet = sent[sequence % sentSize];
+	packet.sequence = sequence;
+	packet.acked = false;
+	packet.time = now;
+	packet.message = message;
+	
+	Network::send(address, port, buffer, header + size);
+	lastSend = now;
+	return sequence;
+}
+
+u16 Connection::sendUnreliable(const u8* data, int size) {
+	return send(unreliableFlag, -1, data, size);
+}
+
+bool Connection::sendReliable(const u8* data, int size) {
+	assert(size <= maxReliableSize);
+	ReliableMessage& message = outgoing[nextReliableId % reliableWindow];
+	if (message.used) return false;
+	message.used = true;
+	message.id = nextReliableId++;
+	message.size = size;
+	message.lastSent = now;
+	memcpy(message.data, data, size);
+	send(reliableFlag, message.id, message.data, message.size);
+	return true;
+}
+
+// Records the sequence, false for duplicates and datagrams too old to tell
+bool Connection::received(u16 sequence) {
+	if (!anyReceived) {
+		anyReceived = true;
+		remoteSequence = sequence;
+		receivedBits = 0;
+		return true;
+	}
+	if (sequenceGreater(sequence, remoteSequence)) {
+		u16 shift = sequence - remoteSequence;
+		receivedBits = shift > 32 ? 0 : shift == 32 ? 1u << 31 : (receivedBits << shift) | (1u << (shift - 1));
+		remoteSequence = sequence;
+		return true;
+	}
+	u16 age = remoteSequence - sequence;
+	if (age == 0 || age > 32) return false;
+	u32 bit = 1u << (age - 1);
+	if (receivedBits & bit) return false;
+	receivedBits |= bit;
+	return true;
+}
+
+void Connection::acknowledge(u16 sequence, double time) {
+	SentPacket& packet = sent[sequence % sentSize];
+	if (packet.sequence != sequence || packet.acked) return;
+	packet.acked = true;
+	
+	rtt += (time - packet.time - rtt) * 0.1;
+	
+	if (packet.message >= 0) {
+		ReliableMessage& message = outgoing[packet.message % reliableWindow];
+		if (message.used && message.id == packet.message) message.used = false;
+	}
+	
+	acked[ackedHead] = sequence;
+	ackedHead = (ackedHead + 1) % ackedSize;
+	// Nobody asked for the oldest ones
+	if (ackedHead == ackedTail) ackedTail = (ackedTail + 1) % ackedSize;
+}
+
+void Connection::deliver(Channel channel, const u8* data, int size) {
+	assert(deliveryCount < deliverySize);
+	Message& message = deliveries[deliveryCount++];
+	message.channel = channel;
+	message.data = data;
+	message.size = size;
+}
+
+void Connection::receive(const Packet& packet) {
+	deliveryCount = deliveryIndex = 0;
+	if (packet.size < headerSize) return;
+	
+	u16 sequence = readU16(&packet.data[0]);
+	u16 ack = readU16(&packet.data[2]);
+	u32 ackBits = readU32(&packet.data[4]);
+	u8 flags = packet.data[8];
+	if (!received(sequence)) return;
+	
+	if (flags & hasAckFlag) {
+		acknowledge(ack, packet.time);
+		for (int i = 0; i < 32; ++i) {
+			if (ackBits & (1u << i)) acknowledge((u16)(ack - 1 - i), packet.time);
+		}
+	}
+	
+	switch (flags & ~hasAckFlag) {
+	case unreliableFlag:
+		// sequenced: a datagram that was overtaken is not worth anything anymore
+		if (anyUnreliable && !sequenceGreater(sequence, newestUnreliable)) return;
+		anyUnreliable = true;
+		newestUnreliable = sequence;
+		deliver(UnreliableSequenced, &packet.data[headerSize], packet.size - headerSize);
+		break;
+	case reliableFlag: {
+		if (packet.size < reliableHeaderSize) return;
+		u16 id = readU16(&packet.data[headerSize]);
+		const u8* data = &packet.data[reliableHeaderSize];
+		int size = packet.size - reliableHeaderSize;
+		if (id == expectedReliableId) {
+			deliver(ReliableOrdered, data, size);
+			++expectedReliableId;
+			// and whatever arrived early and waited for this one
+			while (true) {
+				ReliableMessage& waiting = incoming[expectedReliableId % reliableWindow];
+				if (!waiting.used || waiting.id != expectedReliableId) break;
+				waiting.used = false;
+				deliver(ReliableOrdered, waiting.data, waiting.size);
+				++expectedReliableId;
+			}
+		}
+		else if (sequenceGreater(id, expectedReliableId) && (u16)(id - expectedReliableId) < reliableWindow && size <= maxReliableSize) {
+			ReliableMessage& early = incoming[id % reliableWindow];
+			early.used = true;
+			early.id = id;
+			early.size = size;
+			memcpy(early.data, data, size);
+		}
+		break;
+	}
+	}
+}
+
+bool Connection::firstMessage(const Packet& packet, Message& message) {
+	if (packet.size < reliableHeaderSize) return false;
+	if ((packet.data[8] & ~hasAckFlag) != reliableFlag || readU16(&packet.data[headerSize]) != 0) return false;
+	message.channel = ReliableOrdered;
+	message.data = &packet.data[reliableHeaderSize];
+	message.size = packet.size - reliableHeaderSize;
+	return true;
+}
+
+bool Connection::nextMessage(Message& message) {
+	if (deliveryIndex == deliveryCount) return false;
+	message = deliveries[deliveryIndex++];
+	return true;
+}
+
+bool Connection::nextAcked(u16& sequence) {
+	if (ackedTail == ackedHead) return false;
+	sequence = acked[ackedTail];
+	ackedTail = (ackedTail + 1) % ackedSize;
+	return true;
+}
+
+void Connection::update(double now) {
+	this->now = now;
+	
+	double timeout = rtt * 1.5 + 0.02;
+	for (int i = 0; i < reliableWindow; ++i) {
+		ReliableMessage& message = outgoing[i];
+		if (!message.used || now - message.lastSent < timeout) continue;
+		message.lastSent = now;
+		send(reliableFlag, message.id, message.data, message.size);
+		++resent;
+	}
+	
+	if (now - lastSend > heartbeatInterval) send(ackOnlyFlag, -1, nullptr, 0);
+	
+	// The other side acks at least every heartbeat, what is not acked by then is lost
+	double lossTimeout = rtt * 2 + heartbeatInterval * 2;
+	while (unjudgedSequence != localSequence) {
+		const SentPacket& packet = sent[unjudgedSequence % sentSize];
+		if (packet.sequence == unjudgedSequence) {
+			if (!packet.acked && now - packet.time < lossTimeout) break;
+			loss += ((packet.acked ? 0.0 : 1.0) - loss) * 0.02;
+		}
+		++unjudgedSequence;
+	}
+}
+
+double Connection::roundTripTime() const {
+	return rtt;
+}
+
+double Connection::packetLoss() const {
+	return loss;
+}
+
+int Connection::resentMessages() const {
+	return resent;
+}
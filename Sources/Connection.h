@@ -0,0 +1,114 @@
+#pragma once
+
+#include "Network.h"
+
+enum Channel {
+	// Dropped when a newer message arrived first, for state that is sent over and over
+	UnreliableSequenced,
+	// Resent until acknowledged and delivered in order, for events
+	ReliableOrdered
+};
+
+struct Message {
+	Channel channel;
+	const Kore::u8* data;
+	int size;
+};
+
+// Sequence numbers, acks and resends for the datagrams exchanged with one
+// remote address. Every datagram acknowledges the newest 33 received ones,
+// so there are no separate ack packets as long as both sides send anything.
+// Reliable messages travel in their own datagrams and are only held back by
+// missing older reliable messages, never by the unreliable stream.
+class Connection {
+public:
+	static const int maxReliableSize = 256;
+	// Room left for messages after the header
+	static const int maxMessageSize = Packet::maxSize - 11;
+	
+	Connection();
+	
+	void init(unsigned address, int port);
+	
+	// Returns the sequence number of the datagram, see nextAcked()
+	Kore::u16 sendUnreliable(const Kore::u8* data, int size);
+	// False when too many reliable messages are still unacknowledged
+	bool sendReliable(const Kore::u8* data, int size);
+	
+	void receive(const Packet& packet);
+	// The first reliable message of a connection if the datagram carries it,
+	// so a master can look at packets from strangers without a connection
+	static bool firstMessage(const Packet& packet, Message& message);
+	// Messages of the last received packet, valid until the next receive()
+	bool nextMessage(Message& message);
+	// Sequence numbers of sent datagrams the other side acknowledged
+	bool nextAcked(Kore::u16& sequence);
+	
+	// Call once per frame, resends reliable messages and keeps acks flowing
+	void update(double now);
+	
+	double roundTripTime() const;
+	// Smoothed fraction of the sent datagrams that were never acknowledged
+	double packetLoss() const;
+	int resentMessages() const;
+
+private:
+	static const int sentSize = 256;
+	static const int reliableWindow = 32;
+	static const int deliverySize = reliableWindow + 1;
+	static const int ackedSize = 64;
+	
+	struct SentPacket {
+		Kore::u16 sequence;
+		bool acked;
+		double time;
+		// Reliable message id carried, -1 for none
+		int message;
+	};
+	
+	struct ReliableMessage {
+		bool used;
+		Kore::u16 id;
+		double lastSent;
+		int size;
+		Kore::u8 data[maxReliableSize];
+	};
+	
+	Kore::u16 send(int flags, int message, const Kore::u8* data, int size);
+	bool received(Kore::u16 sequence);
+	void acknowledge(Kore::u16 sequence, double time);
+	void deliver(Channel channel, const Kore::u8* data, int size);
+	
+	unsigned address;
+	int port;
+	double now;
+	double lastSend;
+	
+	Kore::u16 localSequence;
+	SentPacket sent[sentSize];
+	// Oldest sent datagram not yet counted as delivered or lost
+	Kore::u16 unjudgedSequence;
+	
+	bool anyReceived;
+	Kore::u16 remoteSequence;
+	Kore::u32 receivedBits;
+	bool anyUnreliable;
+	Kore::u16 newestUnreliable;
+	
+	Kore::u16 nextReliableId;
+	ReliableMessage outgoing[reliableWindow];
+	Kore::u16 expectedReliableId;
+	ReliableMessage incoming[reliableWindow];
+	
+	Message deliveries[deliverySize];
+	int deliveryCount;
+	int deliveryIndex;
+	
+	Kore::u16 acked[ackedSize];
+	int ackedHead;
+	int ackedTail;
+	
+	double rtt;
+	double loss;
+	int resent;
+};
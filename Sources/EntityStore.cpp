@@ -0,0 +1,240 @@
+#include "pch.h"
+
+#include "EntityStore.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ENTITY_SSE
+#include <emmintrin.h>
+#endif
+#ifdef __AVX__
+#define ENTITY_AVX
+#include <immintrin.h>
+#endif
+
+using namespace Kore;
+
+namespace {
+	// Eight floats, one AVX vector
+	const int width = 8;
+	const size_t alignment = 32;
+	
+	// The playfield of the simulation
+	const float minX = -1, maxX = 1;
+	const float minY = -4, maxY = 4;
+	
+	float* allocateArray(int capacity, MemoryTag tag, float value) {
+		float* data = Memory::allocate<float>(tag, capacity, alignment);
+		for (int i = 0; i < capacity; ++i) data[i] = value;
+		return data;
+	}
+
+#if defined(ENTITY_SSE) && !defined(ENTITY_AVX)
+	__m128 select(__m128 mask, __m128 a, __m128 b) {
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+#endif
+}
+
+EntityStore::EntityStore(int capacity, MemoryTag tag) : count(0) {
+	this->capacity = (capacity + width - 1) / width * width;
+#ifdef ENTITY_SSE
+	simd = true;
+#else
+	simd = false;
+#endif
+	x = allocateArray(this->capacity, tag, 0);
+	y = allocateArray(this->capacity, tag, 0);
+	z = allocateArray(this->capacity, tag, 0);
+	vx = allocateArray(this->capacity, tag, 0);
+	vy = allocateArray(this->capacity, tag, 0);
+	vz = allocateArray(this->capacity, tag, 0);
+	// identity rotations, so the unused entries never divide by zero
+	qx = allocateArray(this->capacity, tag, 0);
+	qy = allocateArray(this->capacity, tag, 0);
+	qz = allocateArray(this->capacity, tag, 0);
+	qw = allocateArray(this->capacity, tag, 1);
+	sx = allocateArray(this->capacity, tag, 0);
+	sy = allocateArray(this->capacity, tag, 0);
+	sz = allocateArray(this->capacity, tag, 0);
+	sw = allocateArray(this->capacity, tag, 1);
+}
+
+int EntityStore::add(const EntityState& state, float vx, float vy, float vz, const Quaternion& spin) {
+	if (count == capacity) return -1;
+	int index = count++;
+	x[index] = state.x;
+	y[index] = state.y;
+	z[index] = state.z;
+	this->vx[index] = vx;
+	this->vy[index] = vy;
+	this->vz[index] = vz;
+	qx[index] = state.rotation.x;
+	qy[index] = state.rotation.y;
+	qz[index] = state.rotation.z;
+	qw[index] = state.rotation.w;
+	sx[index] = spin.x;
+	sy[index] = spin.y;
+	sz[index] = spin.z;
+	sw[index] = spin.w;
+	return index;
+}
+
+int EntityStore::size() const {
+	return count;
+}
+
+EntityState EntityStore::state(int index) const {
+	EntityState state;
+	state.x = x[index];
+	state.y = y[index];
+	state.z = z[index];
+	state.rotation = Quaternion(qx[index], qy[index], qz[index], qw[index]);
+	return state;
+}
+
+void EntityStore::setSimd(bool enabled) {
+#ifdef ENTITY_SSE
+	simd = enabled;
+#else
+	(void)enabled;
+#endif
+}
+
+// Position plus velocity, then the rotation is multiplied by the spin from the left and normalized
+void EntityStore::tickScalar(int first, int last) {
+	for (int i = first; i < last; ++i) {
+		x[i] += vx[i];
+		if (x[i] < minX) x[i] = minX;
+		if (x[i] > maxX) x[i] = maxX;
+		y[i] += vy[i];
+		if (y[i] < minY) y[i] = maxY;
+		else if (y[i] > maxY) y[i] = minY;
+		z[i] += vz[i];
+		
+		float w = sw[i] * qw[i] - sx[i] * qx[i] - sy[i] * qy[i] - sz[i] * qz[i];
+		float rx = sw[i] * qx[i] + sx[i] * qw[i] + sy[i] * qz[i] - sz[i] * qy[i];
+		float ry = sw[i] * qy[i] - sx[i] * qz[i] + sy[i] * qw[i] + sz[i] * qx[i];
+		float rz = sw[i] * qz[i] + sx[i] * qy[i] - sy[i] * qx[i] + sz[i] * qw[i];
+		float scale = 1.0f / sqrtf(rx * rx + ry * ry + rz * rz + w * w);
+		qx[i] = rx * scale;
+		qy[i] = ry * scale;
+		qz[i] = rz * scale;
+		qw[i] = w * scale;
+	}
+}
+
+void EntityStore::tick() {
+	if (!simd) {
+		tickScalar(0, count);
+		return;
+	}
+#ifdef ENTITY_SSE
+	// the arrays are padded to whole vectors, the entries past count are updated along
+	int end = (count + width - 1) / width * width;
+#ifdef ENTITY_AVX
+	const __m256 lowX = _mm256_set1_ps(minX), highX = _mm256_set1_ps(maxX);
+	const __m256 lowY = _mm256_set1_ps(minY), highY = _mm256_set1_ps(maxY);
+	for (int i = 0; i < end; i += 8) {
+		__m256 px = _mm256_add_ps(_mm256_load_ps(&x[i]), _mm256_load_ps(&vx[i]));
+		_mm256_store_ps(&x[i], _mm256_min_ps(_mm256_max_ps(px, lowX), highX));
+		// below the bottom jumps to the top, above the top to the bottom
+		__m256 py = _mm256_add_ps(_mm256_load_ps(&y[i]), _mm256_load_ps(&vy[i]));
+		__m256 below = _mm256_cmp_ps(py, lowY, _CMP_LT_OQ);
+		__m256 above = _mm256_cmp_ps(py, highY, _CMP_GT_OQ);
+		py = _mm256_blendv_ps(_mm256_blendv_ps(py, lowY, above), highY, below);
+		_mm256_store_ps(&y[i], py);
+		_mm256_store_ps(&z[i], _mm256_add_ps(_mm256_load_ps(&z[i]), _mm256_load_ps(&vz[i])));
+	}
+#else
+	const __m128 lowX = _mm_set1_ps(minX), highX = _mm_set1_ps(maxX);
+	const __m128 lowY = _mm_set1_ps(minY), highY = _mm_set1_ps(maxY);
+	for (int i = 0; i < end; i += 4) {
+		__m128 px = _mm_add_ps(_mm_load_ps(&x[i]), _mm_load_ps(&vx[i]));
+		_mm_store_ps(&x[i], _mm_min_ps(_mm_max_ps(px, lowX), highX));
+		// below the bottom jumps to the top, above the top to the bottom
+		__m128 py = _mm_add_ps(_mm_load_ps(&y[i]), _mm_load_ps(&vy[i]));
+		__m128 below = _mm_cmplt_ps(py, lowY);
+		__m128 above = _mm_cmpgt_ps(py, highY);
+		py = select(below, highY, select(above, lowY, py));
+		_mm_store_ps(&y[i], py);
+		_mm_store_ps(&z[i], _mm_add_ps(_mm_load_ps(&z[i]), _mm_load_ps(&vz[i])));
+	}
+#endif
+	
+	// quaternions need no more than SSE
+	const __m128 one = _mm_set1_ps(1.0f);
+	for (int i = 0; i < end; i += 4) {
+		__m128 ax = _mm_load_ps(&sx[i]), ay = _mm_load_ps(&sy[i]), az = _mm_load_ps(&sz[i]), aw = _mm_load_ps(&sw[i]);
+		__m128 bx = _mm_load_ps(&qx[i]), by = _mm_load_ps(&qy[i]), bz = _mm_load_ps(&qz[i]), bw = _mm_load_ps(&qw[i]);
+		__m128 w = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(aw, bw), _mm_mul_ps(ax, bx)), _mm_add_ps(_mm_mul_ps(ay, by), _mm_mul_ps(az, bz)));
+		__m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(aw, bx), _mm_mul_ps(ax, bw)), _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by)));
+		__m128 ry = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(aw, by), _mm_mul_ps(ax, bz)), _mm_add_ps(_mm_mul_ps(ay, bw), _mm_mul_ps(az, bx)));
+		__m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(aw, bz), _mm_mul_ps(ax, by)), _mm_sub_ps(_mm_mul_ps(az, bw), _mm_mul_ps(ay, bx)));
+		__m128 length = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, rx), _mm_mul_ps(ry, ry)), _mm_add_ps(_mm_mul_ps(rz, rz), _mm_mul_ps(w, w)));
+		__m128 scale = _mm_div_ps(one, _mm_sqrt_ps(length));
+		_mm_store_ps(&qx[i], _mm_mul_ps(rx, scale));
+		_mm_store_ps(&qy[i], _mm_mul_ps(ry, scale));
+		_mm_store_ps(&qz[i], _mm_mul_ps(rz, scale));
+		_mm_store_ps(&qw[i], _mm_mul_ps(w, scale));
+	}
+#endif
+}
+
+void EntityStore::buildMatricesScalar(mat4* matrices, int first, int last) const {
+	for (int i = first; i < last; ++i) {
+		float xx = qx[i] * qx[i], yy = qy[i] * qy[i], zz = qz[i] * qz[i];
+		float xy = qx[i] * qy[i], xz = qx[i] * qz[i], yz = qy[i] * qz[i];
+		float wx = qw[i] * qx[i], wy = qw[i] * qy[i], wz = qw[i] * qz[i];
+		// column major, the columns are the rotated axes and the translation
+		float* m = &matrices[i].matrix[0][0];
+		m[0] = 1 - 2 * (yy + zz);
+		m[1] = 2 * (xy + wz);
+		m[2] = 2 * (xz - wy);
+		m[3] = 0;
+		m[4] = 2 * (xy - wz);
+		m[5] = 1 - 2 * (xx + zz);
+		m[6] = 2 * (yz + wx);
+		m[7] = 0;
+		m[8] = 2 * (xz + wy);
+		m[9] = 2 * (yz - wx);
+		m[10] = 1 - 2 * (xx + yy);
+		m[11] = 0;
+		m[12] = x[i];
+		m[13] = y[i];
+		m[14] = z[i];
+		m[15] = 1;
+	}
+}
+
+void EntityStore::buildMatrices(mat4* matrices) const {
+	int first = 0;
+#ifdef ENTITY_SSE
+	if (simd) {
+		const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f), zero = _mm_setzero_ps();
+		// every vector holds one matrix element of four entities, a transpose turns them into four columns
+		for (; first + 4 <= count; first += 4) {
+			int i = first;
+			__m128 x4 = _mm_load_ps(&qx[i]), y4 = _mm_load_ps(&qy[i]), z4 = _mm_load_ps(&qz[i]), w4 = _mm_load_ps(&qw[i]);
+			__m128 xx = _mm_mul_ps(x4, x4), yy = _mm_mul_ps(y4, y4), zz = _mm_mul_ps(z4, z4);
+			__m128 xy = _mm_mul_ps(x4, y4), xz = _mm_mul_ps(x4, z4), yz = _mm_mul_ps(y4, z4);
+			__m128 wx = _mm_mul_ps(w4, x4), wy = _mm_mul_ps(w4, y4), wz = _mm_mul_ps(w4, z4);
+			
+			__m128 columns[4][4] = {
+				{ _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), _mm_mul_ps(two, _mm_add_ps(xy, wz)), _mm_mul_ps(two, _mm_sub_ps(xz, wy)), zero },
+				{ _mm_mul_ps(two, _mm_sub_ps(xy, wz)), _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), _mm_mul_ps(two, _mm_add_ps(yz, wx)), zero },
+				{ _mm_mul_ps(two, _mm_add_ps(xz, wy)), _mm_mul_ps(two, _mm_sub_ps(yz, wx)), _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), zero },
+				{ _mm_load_ps(&x[i]), _mm_load_ps(&y[i]), _mm_load_ps(&z[i]), one }
+			};
+			for (int column = 0; column < 4; ++column) {
+				__m128* c = columns[column];
+				_MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+				for (int lane = 0; lane < 4; ++lane) _mm_storeu_ps(&matrices[i + lane].matrix[column][0], c[lane]);
+			}
+		}
+	}
+#endif
+	buildMatricesScalar(matrices, first, count);
+}
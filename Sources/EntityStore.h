@@ -0,0 +1,52 @@
+#pragma once
+
+#include <Kore/Math/Matrix.h>
+#include "Memory.h"
+#include "Snapshot.h"
+
+// Many moving entities kept as one array per component instead of one object
+// each. tick() moves all of them by their velocity, clamps x and wraps y like
+// the simulation does and turns them by their spin, eight at a time with AVX
+// or four with SSE. buildMatrices() writes every model matrix in one pass.
+// Builds without SSE use the scalar kernels, which can also be picked at
+// runtime to compare them.
+class EntityStore {
+public:
+	// The arrays come from the main allocator and live as long as it does
+	EntityStore(int capacity, MemoryTag tag = GeneralMemory);
+	
+	// Velocity and spin are per tick, returns the index or -1 when the store is full
+	int add(const EntityState& state, float vx, float vy, float vz, const Kore::Quaternion& spin);
+	int size() const;
+	EntityState state(int index) const;
+	
+	void setSimd(bool enabled);
+	
+	void tick();
+	// Writes size() matrices, the same as Translation * rotation.matrix()
+	void buildMatrices(Kore::mat4* matrices) const;
+
+private:
+	void tickScalar(int first, int last);
+	void buildMatricesScalar(Kore::mat4* matrices, int first, int last) const;
+	
+	// Rounded up to a whole number of vectors, the entries past count stay harmless
+	int capacity;
+	int count;
+	bool simd;
+	float* x;
+	float* y;
+	float* z;
+	float* vx;
+	float* vy;
+	float* vz;
+	// Rotation and the rotation added every tick
+	float* qx;
+	float* qy;
+	float* qz;
+	float* qw;
+	float* sx;
+	float* sy;
+	float* sz;
+	float* sw;
+};
@@ -1,5 +1,9 @@
 #include <Kore/pch.h>
 
+// The headless master has its own kore() in HeadlessMaster.cpp and the benchmark runner its own
+// in Benchmark.cpp, neither needs anything from here
+#if !defined(HEADLESS) && !defined(BENCHMARK)
+
 #include <Kore/IO/FileReader.h>
 #include <Kore/Math/Core.h>
 #include <Kore/System.h>
@@ -11,75 +15,49 @@
 #include <Kore/Threads/Mutex.h>
 #include <Kore/Network/Socket.h>
 #include <Kore/Log.h>
+#include <string.h>
 #include "ObjLoader.h"
 #include "Memory.h"
+#include "MeshCache.h"
+#include "AssetLoader.h"
+#include "BoundingVolumeHierarchy.h"
+#include "Collisions.h"
+#include "Network.h"
+#include "Pool.h"
+#include "Recording.h"
+#include "RenderQueue.h"
+#include "Simulation.h"
+#ifdef MASTER
+#include "Master.h"
+#else
+#include "Slave.h"
+#endif
 
 #include "MeshObject.h"
 
+// Default ports, both can be changed on the command line
+#define MASTER_PORT 9898
+#define SLAVE_PORT 9897
+
 #ifdef MASTER
-#define SRC_PORT 9898
-#define DEST_PORT 9897
 #define CLIENT_NAME "Master"
 #else
-#define SRC_PORT 9897
-#define DEST_PORT 9898
 #define CLIENT_NAME "Slave"
 #endif
 
-#define DEST_IP1 127
-#define DEST_IP2 0
-#define DEST_IP3 0
-#define DEST_IP4 1
-
 using namespace Kore;
 
-enum MessageType {
-	Hello,
-	NpcPos
-};
-
+// Shows one ball of the simulation
 class Ball : public MeshObject {
 public:
-	Ball(float x, float y, float z, const Graphics4::VertexStructure& structure, float scale = 1.0f) : MeshObject("ball.obj", "unshaded.png", structure, scale), x(x), y(y), z(z), dir(0, 0, 0) {
-		rotation = Quaternion(vec3(0, 0, 1), 0);
-	}
+	Ball(const Graphics4::VertexStructure& structure, float scale = 1.0f) : MeshObject("ball.obj", "unshaded.png", structure, scale) {}
 	
-	void update(float tdif) override {
-		vec3 dir = this->dir;
-		if (dir.getLength() != 0) dir.setLength(dir.getLength() * tdif * 60.0f);
-		x += dir.x();
-		if (x > 1) {
-			x = 1;
-		}
-		if (x < -1) {
-			x = -1;
-		}
-		y += dir.y();
-		if (y < -4) {
-			y = 4;
-		}
-		if (y > 4) {
-			y = -4;
-		}
-		z += dir.z();
-		if (dir.getLength() != 0) {
-			float Horizontal = dir.dot(vec3(1, 0, 0));
-			float Vertical = dir.dot(vec3(0, 1, 0));
-			
-			rotation = rotation.rotated(Quaternion(vec3(-1, 0, 0), Vertical * 3.0f));
-			rotation = rotation.rotated(Quaternion(vec3(0, 1, 0), Horizontal * 3.0f));
-		}
-		M = mat4::Translation(x, y, z) * rotation.matrix();
+	void setState(const EntityState& state) {
+		M = mat4::Translation(state.x, state.y, state.z) * state.rotation.matrix();
 	}
-	
-	vec3 dir;
-	Quaternion rotation;
-	float x, y, z;
 };
 
 namespace {
-	void updateBall();
-	
 	const int width = 512;
 	const int height = 512;
 	
@@ -88,163 +66,243 @@ namespace {
 	Graphics4::Shader* fragmentShader;
 	Graphics4::PipelineState* pipeline;
 	
+	Graphics4::VertexStructure structure;
+	// The model matrix of every object as a second vertex stream
+	Graphics4::VertexStructure instanceStructure;
+	RenderQueue queue(instanceStructure);
+	
 	// null terminated array of MeshObject pointers
-	MeshObject* objects[] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
-	Ball* balls[] = { nullptr, nullptr, nullptr };
+	MeshObject* objects[] = { nullptr, nullptr, nullptr };
+	// by ball id, nullptr while the ball is not shown
+	Ball* balls[maxEntities];
+	Pool<Ball, maxEntities> ballPool;
+	// keep the ball's buffers uploaded while no ball is shown
+	MeshAsset* ballMesh;
+	TextureAsset* ballTexture;
+	
+	// Every frame only the objects in the view are drawn
+	const int maxVisible = sizeof(objects) / sizeof(objects[0]) + maxEntities;
+	BoundingVolumeHierarchy hierarchy;
+	int drawnObjects = 0;
+	int culledObjects = 0;
+	int renderedFrames = 0;
 	
 	// uniform locations - add more as you see fit
 	Graphics4::TextureUnit tex;
 	Graphics4::ConstantLocation pvLocation;
-	Graphics4::ConstantLocation mLocation;
 	
 	mat4 PV;
+	// PV is only computed again when the camera moved
+	vec3 pvPosition;
+	bool pvValid = false;
+	
+	// Every client starts from the same seed and advances in fixed ticks
+	Simulation simulation;
+	double accumulator = 0;
+	// After a long hitch the simulation skips time instead of trying to catch up forever
+	const int maxTicksPerFrame = 5;
 	
-	float lastTime = 0.0;
+	double lastFrame;
+	float frameTime = 0;
 	
-	Socket socket;
 	vec3 position(0, 0, -2.25);
 	
-	const int port = SRC_PORT;
-	const int destPort = DEST_PORT;
+#ifdef MASTER
+	int port = MASTER_PORT;
+	Master master(simulation);
+#else
+	int port = SLAVE_PORT;
+	int destPort = MASTER_PORT;
 	const char* destination = "localhost";
+	Slave slave(simulation);
+#endif
 	
-	// Send a packet to the other client
-	// length is the length of the packet in bytes
-	void sendPacket(const unsigned char data[], int length) {
-		socket.send(destination, destPort, data, length);
-	}
+	// Time from the network thread receiving a packet to the game loop applying it
+	double latencySum = 0;
+	double latencyMax = 0;
+	int latencyCount = 0;
+	double lastLatencyLog = 0;
 	
-	// Movement data for clients
+	// Movement data of the local player
 	bool left = false, right = false, up = false, down = false;
-	bool left2 = false, right2 = false, up2 = false, down2 = false;
 	
-	void update() {
-		// receive packets
-		while (true) {
-			// Read buffer
-			u8 buffer[256];
-			unsigned fromAddress;
-			unsigned fromPort;
-			int read = socket.receive(buffer, sizeof(buffer), fromAddress, fromPort);
-			
-			// break if there was no new packet
-			if (read <= 0) {
-				break;
-			}
-			
-			/************************************************************************/
-			/* Practical Task: Read the packets with the movement data you sent  and
-			/* apply them by setting the boolean values for movement control.
-			/************************************************************************/
+	void logLatency(double now) {
+		if (now - lastLatencyLog < 5.0) return;
 #ifdef MASTER
-			// Set the values for left2, right2, up2, down2 here
+		NetworkStats stats = master.takeStats();
 #else
-			// Set the values for left, right, up, down here
-			
-			// receive position updates of the npc ball
+		NetworkStats stats = slave.takeStats();
+#endif
+		if (latencyCount > 0) {
+			log(Info, "Packet latency to simulation: %.2f ms average, %.2f ms max, %i packets dropped", latencySum / latencyCount * 1000.0, latencyMax * 1000.0, Network::droppedPackets());
+			log(Info, "Round trip time: %.2f ms, %.1f%% packet loss, %i reliable messages resent", stats.roundTripTime * 1000.0, stats.packetLoss * 100.0, stats.resentMessages);
+		}
+		if (renderedFrames > 0) {
+			log(Info, "Rendering: %.1f objects drawn and %.1f culled per frame, %i draw calls, %i state changes", (double)drawnObjects / renderedFrames, (double)culledObjects / renderedFrames, queue.drawCalls(), queue.stateChanges());
+		}
+		if (stats.snapshots > 0) {
+			log(Info, "Snapshots: %.1f bytes each, %.1f bytes as raw floats", (double)stats.snapshotBytes / stats.snapshots, (double)stats.rawSnapshotBytes / stats.snapshots);
+#ifdef MASTER
+			log(Info, "%i clients, %.0f snapshot bytes per second, %.1f snapshots per second per client", master.clientCount(), stats.snapshotBytes / (now - lastLatencyLog), stats.sendRate);
+#else
+			log(Info, "%.1f snapshots per second", stats.sendRate);
+			log(Info, "Snapshots behind the interpolation delay: %i", stats.lateSnapshots);
+			log(Info, "Prediction: %i corrections, %i ticks replayed", stats.corrections, stats.replayedTicks);
+#endif
+		}
+		latencySum = latencyMax = 0;
+		latencyCount = 0;
+		drawnObjects = culledObjects = renderedFrames = 0;
+		lastLatencyLog = now;
+	}
 
-			if (buffer[0] == NpcPos) {
-				float* floats = (float*)&buffer[1];
-				balls[2]->x = floats[0];
-				balls[2]->y = floats[1];
-				balls[2]->z = floats[2];
+#ifdef MASTER
+	// Catching the falling ball sends it back to the top
+	void contact(const Contact& contact) {
+		int player = contact.a == Simulation::npcBall ? contact.b : contact.b == Simulation::npcBall ? contact.a : -1;
+		if (player < 0) return;
+		log(Info, "Player %i caught the ball", player);
+		simulation.respawnNpc();
+	}
+#endif
+	
+	void receive(const Packet& packet, double now) {
+		double latency = now - packet.time;
+		latencySum += latency;
+		if (latency > latencyMax) latencyMax = latency;
+		++latencyCount;
+#ifdef MASTER
+		master.receive(packet);
+#else
+		slave.receive(packet);
+#endif
+	}
+	
+	// Everything of a frame after the packets except rendering, replays call it directly
+	void step(double now) {
+#ifdef MASTER
+		master.update(now);
+#else
+		slave.update(now);
+#endif
+		logLatency(now);
+		
+		frameTime = (float)(now - lastFrame);
+		lastFrame = now;
+		
+		// advance the simulation in fixed ticks, independent of the frame rate
+		accumulator += frameTime;
+		int ticks = 0;
+		while (accumulator >= tickTime) {
+			if (ticks == maxTicksPerFrame) {
+				accumulator = 0;
+				break;
 			}
-#endif // MASTER
-			
-			updateBall();
+			PlayerInput input = { left, right, up, down };
+#ifdef MASTER
+			master.tick(input);
+#else
+			slave.tick(input);
+#endif
+			accumulator -= tickTime;
+			++ticks;
 		}
+	}
+	
+	void frame(double now) {
+		Recording::frame(now);
+		// receive packets queued by the network thread
+		while (const Packet* packet = Network::receive()) {
+			receive(*packet, now);
+		}
+		step(now);
+	}
+	
+	// Render proxies come and go with the balls
+	void showBalls(const u16* ids, const EntityState* states, int count) {
+		bool* shown = Memory::allocateFrame<bool>(maxEntities);
+		memset(shown, 0, maxEntities * sizeof(bool));
+		for (int i = 0; i < count; ++i) {
+			Ball*& ball = balls[ids[i]];
+			if (ball == nullptr) ball = ballPool.create(structure, ballScale);
+			ball->setState(states[i]);
+			shown[ids[i]] = true;
+		}
+		for (int i = 0; i < maxEntities; ++i) {
+			if (balls[i] == nullptr || shown[i]) continue;
+			ballPool.destroy(balls[i]);
+			balls[i] = nullptr;
+		}
+	}
+	
+	void update() {
+		frame(System::time());
 		
-		float t = (float)(System::time() - startTime);
-		float tdif = t - lastTime;
-		lastTime = t;
-		
-		updateBall();
+		// render between the last two ticks
+		float alpha = (float)(accumulator / tickTime);
+		u16* ids = Memory::allocateFrame<u16>(maxEntities);
+		EntityState* states = Memory::allocateFrame<EntityState>(maxEntities);
+		int count = 0;
+#ifdef MASTER
+		for (int i = 0; i < Simulation::maxBalls; ++i) {
+			if (!simulation.isActive(i)) continue;
+			ids[count] = (u16)i;
+			states[count++] = simulation.renderState(i, alpha);
+		}
+#else
+		if (slave.joined()) {
+			ids[count] = (u16)slave.ownBall();
+			states[count++] = simulation.renderState(slave.ownBall(), alpha);
+		}
+		count += slave.remoteBalls(System::time(), &ids[count], &states[count], maxEntities - count);
+#endif
+		showBalls(ids, states, count);
 		
 		Graphics4::begin();
 		Graphics4::clear(Graphics4::ClearColorFlag | Graphics4::ClearDepthFlag, 0xff9999FF, 1.0f);
 		
-		Graphics4::setPipeline(pipeline);
-		
-		PV = mat4::Perspective(90, (float)width / (float)height, 0.1f, 100) * mat4::lookAt(position, vec3(0.0, 0.0, 0.0), vec3(0, 1, 0));
-		Graphics4::setMatrix(pvLocation, PV);
+		if (!pvValid || position != pvPosition) {
+			PV = mat4::Perspective(90, (float)width / (float)height, 0.1f, 100) * mat4::lookAt(position, vec3(0.0, 0.0, 0.0), vec3(0, 1, 0));
+			pvPosition = position;
+			pvValid = true;
+		}
 		
+		MeshObject** candidates = Memory::allocateFrame<MeshObject*>(maxVisible);
+		int candidateCount = 0;
 		MeshObject** current = &objects[0];
 		while (*current != nullptr) {
-			(*current)->update(tdif);
-			Graphics4::setMatrix(mLocation, (*current)->M);
-			(*current)->render(tex);
+			(*current)->update(frameTime);
+			candidates[candidateCount++] = *current;
 			++current;
 		}
+		for (int i = 0; i < maxEntities; ++i) {
+			if (balls[i] != nullptr) candidates[candidateCount++] = balls[i];
+		}
 		
-#ifdef MASTER
-		// send position of the npc ball
-		u8 data[1 + sizeof(float) * 3];
-		float* fdata = (float*)&data[1];
+		// world space bounds from the current matrices, the hierarchy is only good for this frame
+		Aabb* bounds = Memory::allocateFrame<Aabb>(candidateCount);
+		for (int i = 0; i < candidateCount; ++i) bounds[i] = candidates[i]->bounds();
+		hierarchy.build(bounds, candidateCount);
+		int* visible = Memory::allocateFrame<int>(candidateCount);
+		int visibleCount = hierarchy.cull(Frustum(PV), visible, candidateCount);
+		drawnObjects += visibleCount;
+		culledObjects += candidateCount - visibleCount;
+		++renderedFrames;
 		
-		data[0] = (u8)NpcPos;
-		fdata[0] = balls[2]->x;
-		fdata[1] = balls[2]->y;
-		fdata[2] = balls[2]->z;
-		sendPacket(data, sizeof(data));
-#endif
+		// all balls share a mesh and a texture and take one draw call, sorted by pipeline, texture and mesh
+		queue.begin();
+		for (int i = 0; i < visibleCount; ++i) candidates[visible[i]]->render(queue);
+		queue.draw(PV);
 		
 		Graphics4::end();
 		Graphics4::swapBuffers();
+		
+		Memory::endFrame();
 	}
 	
-	void updateBall() {
-		// user controlled balls
-		float speed = 0.05f;
-		if (left) {
-			balls[0]->dir.x() = -speed;
-		}
-		else if (right) {
-			balls[0]->dir.x() = speed;
-		}
-		else {
-			balls[0]->dir.x() = 0;
-		}
-		if (up) {
-			balls[0]->dir.y() = speed;
-		}
-		else if (down) {
-			balls[0]->dir.y() = -speed;
-		}
-		else {
-			balls[0]->dir.y() = 0;
-		}
-		if (left2) {
-			balls[1]->dir.x() = -speed;
-		}
-		else if (right2) {
-			balls[1]->dir.x() = speed;
-		}
-		else {
-			balls[1]->dir.x() = 0;
-		}
-		if (up2) {
-			balls[1]->dir.y() = speed;
-		}
-		else if (down2) {
-			balls[1]->dir.y() = -speed;
-		}
-		else {
-			balls[1]->dir.y() = 0;
-		}
-		// NPC ball
-		balls[2]->dir.y() = -0.04f;
-#ifdef MASTER
-		if (balls[2]->y == 4) {
-			balls[2]->x = ((float)rand() / RAND_MAX)*2-1;
-		}
-#endif
-	}
-	
-	/************************************************************************/
-	/* Practical Task: Send packets with information about the input controls
-	/* of the local player - keyDown
-	/************************************************************************/
+	// inputs are sampled and sent every simulation tick
 	void keyDown(KeyCode code) {
+		Recording::key(code, true);
 #ifdef MASTER
 		if (code == KeyLeft) {
 			left = true;
@@ -260,25 +318,25 @@ namespace {
 		}
 #else
 		if (code == KeyA) {
-			left2 = true;
+			left = true;
 		}
 		else if (code == KeyD) {
-			right2 = true;
+			right = true;
 		}
 		if (code == KeyW) {
-			up2 = true;
+			up = true;
 		}
 		else if (code == KeyS) {
-			down2 = true;
+			down = true;
 		}
 #endif // MASTER
+		if (code == KeyM) {
+			Memory::report();
+		}
 	}
 	
-	/************************************************************************/
-	/* Practical Task: Send packets with information about the input controls
-	/* of the local player - keyUp
-	/************************************************************************/
 	void keyUp(KeyCode code) {
+		Recording::key(code, false);
 #ifdef MASTER
 		if (code == KeyLeft) {
 			left = false;
@@ -294,59 +352,31 @@ namespace {
 		}
 #else
 		if (code == KeyA) {
-			left2 = false;
+			left = false;
 		}
 		else if (code == KeyD) {
-			right2 = false;
+			right = false;
 		}
 		else if (code == KeyW) {
-			up2 = false;
+			up = false;
 		}
 		else if (code == KeyS) {
-			down2 = false;
+			down = false;
 		}
 #endif // MASTER
 	}
 	
 	void init() {
-		srand(42);
-		socket.init();
-		socket.open(port);
+		Network::init(port);
 		
-		// send "hello" when joining to tell other player you are there
-		u8 hello = Hello;
-		sendPacket(&hello, 1);
-		
-#ifdef MASTER
-		log(Info, "Waiting for another player (the SLAVE) to join my game...");
-#else
-		log(Info, "Waiting for another player (the MASTER) in control of the game...");
-#endif // MASTER
-		
-		// wait for other player
-		while (true) {
-			// read buffer
-			unsigned char buffer[256];
-			unsigned fromAddress;
-			unsigned fromPort;
-			int read = socket.receive(buffer, sizeof(buffer), fromAddress, fromPort);
-			if (read <= 0) {
-				continue;
-			}
-			// break if player is there
-			if (buffer[0] == Hello) {
-				break;
-			}
-		}
-		
-#ifdef MASTER
-		log(Info, "Another player (the SLAVE) has joined my game!");
-#else
-		log(Info, "I have joined another players (the MASTER) game!");
-#endif // MASTER
-		
-		// resend hello for newly connected player
-		sendPacket(&hello, 1);
+		// read, parse and decode the assets on worker threads while waiting for the master
+		double loadStart = System::time();
+		AssetLoader::init();
+		AssetLoader::loadMesh("ball.obj");
+		AssetLoader::loadMesh("base.obj");
+		AssetLoader::loadImage("unshaded.png");
+		AssetLoader::loadImage("floor.png");
+		AssetLoader::loadImage("StarMap.png");
 		
 		FileReader vs("shader.vert");
 		FileReader fs("shader.frag");
@@ -354,14 +384,16 @@ namespace {
 		fragmentShader = new Graphics4::Shader(fs.readAll(), fs.size(), Graphics4::FragmentShader);
 		
 		// This defines the structure of your Vertex Buffer
-		Graphics4::VertexStructure structure;
 		structure.add("pos", Graphics4::Float3VertexData);
 		structure.add("tex", Graphics4::Float2VertexData);
 		structure.add("nor", Graphics4::Float3VertexData);
+		instanceStructure.add("M", Graphics4::Float4x4VertexData);
+		instanceStructure.instanced = true;
 		
 		pipeline = new Graphics4::PipelineState;
 		pipeline->inputLayout[0] = &structure;
-		pipeline->inputLayout[1] = nullptr;
+		pipeline->inputLayout[1] = &instanceStructure;
+		pipeline->inputLayout[2] = nullptr;
 		pipeline->vertexShader = vertexShader;
 		pipeline->fragmentShader = fragmentShader;
 		pipeline->depthMode = Graphics4::ZCompareLess;
@@ -370,20 +402,149 @@ namespace {
 		
 		tex = pipeline->getTextureUnit("tex");
 		pvLocation = pipeline->getConstantLocation("PV");
-		mLocation = pipeline->getConstantLocation("M");
+		queue.setPipeline(pipeline, tex, pvLocation);
 		
-		objects[0] = balls[0] = new Ball(0.5f, -2.0f, 0.0f, structure, 0.25f);
-		objects[1] = balls[1] = new Ball(-0.5f, -2.0f, 0.0f, structure, 0.25f);
+#ifdef MASTER
+		AssetLoader::waitForAll();
+		log(Info, "Waiting for other players (SLAVES) to join my game...");
+#else
+		// say hello, it is resent until the master is there to acknowledge it
+		slave.connect(Network::resolve(destination, destPort), destPort, startTime);
+		log(Info, "Waiting for another player (the MASTER) in control of the game...");
+
+		// wait for the master
+		bool loaded = false;
+		while (!slave.joined()) {
+			if (!loaded && AssetLoader::update()) {
+				loaded = true;
+				log(Info, "Assets loaded after %f seconds", System::time() - loadStart);
+			}
+			
+			frame(System::time());
+			// leave the cpu to the loader threads
+			threadSleep(1);
+		}
+		log(Info, "I have joined another players (the MASTER) game as player %i!", slave.ownBall());
+#endif // MASTER
+		
+		// the objects below only upload the already decoded data
+		AssetLoader::shutdown();
+		log(Info, "Ready to start after %f seconds", System::time() - loadStart);
 		
-		objects[2] = balls[2] = new Ball(((float)rand() / RAND_MAX)*2-1, 4.0f, 0.0f, structure, 0.25f);
-		objects[3] = new MeshObject("base.obj", "floor.png", structure);
-		objects[3]->M = mat4::RotationX(Kore::pi / 2.0f)*mat4::Scale(0.15f, 1, 1);
-		objects[4] = new MeshObject("base.obj", "StarMap.png", structure);
-		objects[4]->M = mat4::RotationX(Kore::pi / 2.0f)*mat4::Scale(1, 1, 1)*mat4::Translation(0, 0, 0.5f);
+		ballMesh = Assets::acquireMesh("ball.obj", structure, ballScale);
+#ifdef MASTER
+		master.setBallRadius(sphereRadius(ballMesh->mesh, ballScale));
+#endif
+		ballTexture = Assets::acquireTexture("unshaded.png");
+		objects[0] = new MeshObject("base.obj", "floor.png", structure);
+		objects[0]->M = mat4::RotationX(Kore::pi / 2.0f)*mat4::Scale(0.15f, 1, 1);
+		objects[1] = new MeshObject("base.obj", "StarMap.png", structure);
+		objects[1]->M = mat4::RotationX(Kore::pi / 2.0f)*mat4::Scale(1, 1, 1)*mat4::Translation(0, 0, 0.5f);
 		
 		Graphics4::setTextureAddressing(tex, Graphics4::U, Graphics4::Repeat);
 		Graphics4::setTextureAddressing(tex, Graphics4::V, Graphics4::Repeat);
 	}
+	
+	// FNV-1a over the sent datagrams, without the address that depends on name resolution
+	const u32 hashBasis = 2166136261u;
+	u32 sentHash = hashBasis;
+	int sentCount = 0;
+	
+	u32 hashDatagram(u32 hash, int port, const u8* data, int size) {
+		hash = (hash ^ (u32)port) * 16777619u;
+		for (int i = 0; i < size; ++i) hash = (hash ^ data[i]) * 16777619u;
+		return hash;
+	}
+	
+#ifndef MASTER
+	// Where the recorded slave sent its hello, it only listens to that address and port
+	bool recordedMaster(const char* filename, unsigned& address, int& port) {
+		RecordingReader reader;
+		if (!reader.open(filename)) return false;
+		RecordedEvent event;
+		while (reader.next(event)) {
+			if (event.type != SentRecord) continue;
+			address = event.packet.address;
+			port = (int)event.packet.port;
+			return true;
+		}
+		return false;
+	}
+#endif
+	
+	bool replaySend(unsigned, int port, const u8* data, int size) {
+		sentHash = hashDatagram(sentHash, port, data, size);
+		++sentCount;
+		return true;
+	}
+	
+	// Feeds a recorded session through the game loop without a window and as
+	// fast as possible, and checks that it sends what the recorded one sent
+	void replay(const char* filename) {
+		RecordingReader reader;
+		if (!reader.open(filename)) {
+			log(Error, "Could not open recording %s", filename);
+			return;
+		}
+		Network::setSendHandler(replaySend);
+		startTime = lastFrame = reader.startTime();
+#ifdef MASTER
+		// only the bounds of the ball are needed without a window
+		Mesh* mesh = loadMeshBounds("ball.obj");
+		if (mesh != nullptr) master.setBallRadius(sphereRadius(mesh, ballScale));
+#else
+		unsigned masterAddress = 0;
+		int masterPort = destPort;
+		recordedMaster(filename, masterAddress, masterPort);
+		slave.connect(masterAddress, masterPort, startTime);
+#endif
+		
+		u32 expectedHash = hashBasis;
+		int expectedCount = 0;
+		int frames = 0;
+		int diverged = -1;
+		bool inFrame = false;
+		double now = startTime;
+		double start = System::time();
+		RecordedEvent event;
+		while (reader.next(event)) {
+			if (event.type == ReceivedRecord) {
+				receive(event.packet, now);
+				continue;
+			}
+			if (event.type == SentRecord) {
+				expectedHash = hashDatagram(expectedHash, event.packet.port, event.packet.data, event.packet.size);
+				++expectedCount;
+				continue;
+			}
+			
+			// a frame ends with the first key or frame after its packets
+			if (inFrame) {
+				step(now);
+				inFrame = false;
+			}
+			if (diverged < 0 && (sentCount != expectedCount || sentHash != expectedHash)) diverged = frames;
+			
+			if (event.type == KeyRecord) {
+				if (event.down) keyDown((KeyCode)event.key);
+				else keyUp((KeyCode)event.key);
+			}
+			else {
+				now = event.time;
+				inFrame = true;
+				++frames;
+			}
+		}
+		if (inFrame) step(now);
+		if (diverged < 0 && (sentCount != expectedCount || sentHash != expectedHash)) diverged = frames;
+		Network::setSendHandler(nullptr);
+		
+		double time = System::time() - start;
+		log(Info, "Replayed %i frames (%.1f seconds) in %.3f seconds, %.0f times real time", frames, now - startTime, time, time > 0 ? (now - startTime) / time : 0.0);
+		log(Info, "Simulation at tick %u, checksum %08x", simulation.currentTick(), simulation.checksum());
+		if (diverged < 0) log(Info, "All %i sent datagrams match the recording", sentCount);
+		else log(Warning, "Diverged from the recording in frame %i", diverged);
+	}
 }
 
 int kore(int argc, char** argv) {
@@ -393,22 +554,63 @@ int kore(int argc, char** argv) {
 	log(Info, "I am the SLAVE, I want to join another game.");
 #endif // MASTER
 	
+	// -record <file> writes the session to a file, -replay <file> plays one back without a window,
+	// -memory <file> writes the memory report as JSON when the game ends
+	const char* recordFile = nullptr;
+	const char* replayFile = nullptr;
+	const char* memoryFile = nullptr;
+	const int maxArguments = 8;
+	char* arguments[maxArguments];
+	int count = 0;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-record") == 0 && i + 1 < argc) recordFile = argv[++i];
+		else if (strcmp(argv[i], "-replay") == 0 && i + 1 < argc) replayFile = argv[++i];
+		else if (strcmp(argv[i], "-memory") == 0 && i + 1 < argc) memoryFile = argv[++i];
+		else if (count < maxArguments) arguments[count++] = argv[i];
+	}
+
+#ifdef MASTER
+	if (count > 0) port = atoi(arguments[0]);
+	// snapshots and bytes per second for every slave
+	if (count > 1) master.setSendRate(atoi(arguments[1]));
+	if (count > 2) master.setBytesPerSecond(atoi(arguments[2]));
+	log(Info, "I am listening on port %i", port);
+	master.setContactHandler(contact);
+#else
+	if (count > 0) destination = arguments[0];
+	if (count > 1) destPort = atoi(arguments[1]);
+	if (count > 2) port = atoi(arguments[2]);
 	log(Info, "I am listening on port %i", port);
 	log(Info, "and want to connect to %s:%i\n", destination, destPort);
+#endif // MASTER
+	
+	Memory::init();
+	if (replayFile != nullptr) {
+		replay(replayFile);
+		return 0;
+	}
 	
 	Kore::System::init("Exercise 11 - "  CLIENT_NAME, width, height);
 	
-	Memory::init();
+	startTime = lastFrame = System::time();
+	if (recordFile != nullptr && Recording::start(recordFile, startTime)) {
+		log(Info, "Recording the session to %s", recordFile);
+	}
 	init();
 	
 	Kore::System::setCallback(update);
 	
-	startTime = System::time();
-	
 	Keyboard::the()->KeyDown = keyDown;
 	Keyboard::the()->KeyUp = keyUp;
 	
 	Kore::System::start();
+	// no packets are sent or received behind the recording's back anymore
+	Network::shutdown();
+	Recording::stop();
+	Memory::report();
+	if (memoryFile != nullptr) Memory::writeReport(memoryFile);
 	
 	return 0;
 }
+
+#endif // !HEADLESS && !BENCHMARK
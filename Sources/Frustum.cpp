@@ -0,0 +1,60 @@
+#include "pch.h"
+
+#include "Frustum.h"
+
+#include <math.h>
+
+using namespace Kore;
+
+// Center and half extents are transformed separately, the absolute values of
+// the rotation and scale give the extents of the rotated box
+Aabb Aabb::transformed(const mat4& M) const {
+	Aabb result;
+	for (int row = 0; row < 3; ++row) {
+		float center = M.get(row, 3);
+		float extent = 0;
+		for (int column = 0; column < 3; ++column) {
+			center += M.get(row, column) * (min[column] + max[column]) * 0.5f;
+			extent += fabsf(M.get(row, column)) * (max[column] - min[column]) * 0.5f;
+		}
+		result.min[row] = center - extent;
+		result.max[row] = center + extent;
+	}
+	return result;
+}
+
+float Aabb::center(int axis) const {
+	return (min[axis] + max[axis]) * 0.5f;
+}
+
+// Gribb and Hartmann: a clip space coordinate is inside while -w <= x, y, z <= w,
+// so every plane is the fourth row plus or minus one of the others
+Frustum::Frustum(const mat4& PV) {
+	for (int i = 0; i < 6; ++i) {
+		int row = i / 2;
+		float sign = i % 2 == 0 ? 1.0f : -1.0f;
+		for (int column = 0; column < 4; ++column) {
+			planes[i][column] = PV.get(3, column) + sign * PV.get(row, column);
+		}
+		float length = sqrtf(planes[i][0] * planes[i][0] + planes[i][1] * planes[i][1] + planes[i][2] * planes[i][2]);
+		if (length > 0) {
+			for (int column = 0; column < 4; ++column) planes[i][column] /= length;
+		}
+	}
+}
+
+Frustum::Result Frustum::test(const Aabb& box) const {
+	Result result = Inside;
+	for (int i = 0; i < 6; ++i) {
+		const float* plane = planes[i];
+		float distance = plane[3];
+		float radius = 0;
+		for (int axis = 0; axis < 3; ++axis) {
+			distance += plane[axis] * box.center(axis);
+			radius += fabsf(plane[axis]) * (box.max[axis] - box.min[axis]) * 0.5f;
+		}
+		if (distance < -radius) return Outside;
+		if (distance < radius) result = Intersecting;
+	}
+	return result;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <Kore/Math/Matrix.h>
+
+// Axis aligned box
+struct Aabb {
+	float min[3];
+	float max[3];
+	
+	// Box around this box after the transformation
+	Aabb transformed(const Kore::mat4& M) const;
+	float center(int axis) const;
+};
+
+// The six planes of a projection, pointing inwards
+class Frustum {
+public:
+	enum Result {
+		Outside,
+		Intersecting,
+		Inside
+	};
+	
+	// From the rows of the combined projection and view matrix
+	Frustum(const Kore::mat4& PV);
+	
+	Result test(const Aabb& box) const;
+
+private:
+	// a, b, c, d of ax + by + cz + d >= 0 for points inside
+	float planes[6][4];
+};
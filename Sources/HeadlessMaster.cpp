@@ -0,0 +1,143 @@
+#include "pch.h"
+
+#ifdef HEADLESS
+
+#include <Kore/System.h>
+#include <Kore/Log.h>
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include "Collisions.h"
+#include "Master.h"
+#include "Memory.h"
+#include "MeshCache.h"
+#include "Network.h"
+#include "Simulation.h"
+
+#define MASTER_PORT 9898
+
+using namespace Kore;
+
+// A master without window, graphics or input. It never calls System::init,
+// loads only the bounds of the ball mesh for the collisions and ticks from a
+// steady clock, sleeping until the next tick instead of waiting for frames,
+// so one machine without a gpu can run many of them side by side. "make
+// headless" leaves out Kore's graphics, window and sound code altogether,
+// Sources/HeadlessSystem.cpp stands in for the rest of its system backend.
+namespace {
+	typedef std::chrono::steady_clock Clock;
+	
+	// Ticks missed beyond this (e.g. while the process was stopped) are dropped
+	const int maxTicksPerWakeup = 5;
+	const double statsInterval = 5.0;
+	
+	Simulation simulation;
+	Master master(simulation);
+	
+	// Catching the falling ball sends it back to the top
+	void contact(const Contact& contact) {
+		int player = contact.a == Simulation::npcBall ? contact.b : contact.b == Simulation::npcBall ? contact.a : -1;
+		if (player < 0) return;
+		log(Info, "Player %i caught the ball", player);
+		simulation.respawnNpc();
+	}
+	
+	double seconds(Clock::duration duration) {
+		return std::chrono::duration<double>(duration).count();
+	}
+	
+	// Time spent ticking, the share of one core the master needs
+	Clock::duration tickWork = Clock::duration::zero();
+	int ticks = 0;
+	double lastStats;
+	
+	void logStats(double now) {
+		if (now - lastStats < statsInterval) return;
+		NetworkStats stats = master.takeStats();
+		double interval = now - lastStats;
+		log(Info, "%i clients, %i ticks, %.3f ms per tick, %.1f%% of a core, %i packets dropped", master.clientCount(), ticks, ticks > 0 ? seconds(tickWork) / ticks * 1000.0 : 0.0, seconds(tickWork) / interval * 100.0, Network::droppedPackets());
+		if (stats.snapshots > 0) {
+			log(Info, "%.0f snapshot bytes per second, %.1f snapshots per second per client, %.2f ms round trip time, %.1f%% packet loss", stats.snapshotBytes / interval, stats.sendRate, stats.roundTripTime * 1000.0, stats.packetLoss * 100.0);
+		}
+		tickWork = Clock::duration::zero();
+		ticks = 0;
+		lastStats = now;
+	}
+}
+
+int kore(int argc, char** argv) {
+	log(Info, "I am a headless MASTER, I am in control of the game.");
+	
+	// -seconds <n> stops after n seconds instead of running until killed,
+	// -memory <file> writes the memory report as JSON when it stops
+	double runTime = 0;
+	const char* memoryFile = nullptr;
+	const int maxArguments = 8;
+	char* arguments[maxArguments];
+	int count = 0;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-seconds") == 0 && i + 1 < argc) runTime = atof(argv[++i]);
+		else if (strcmp(argv[i], "-memory") == 0 && i + 1 < argc) memoryFile = argv[++i];
+		else if (count < maxArguments) arguments[count++] = argv[i];
+	}
+	
+	int port = MASTER_PORT;
+	if (count > 0) port = atoi(arguments[0]);
+	// snapshots and bytes per second for every slave
+	if (count > 1) master.setSendRate(atoi(arguments[1]));
+	if (count > 2) master.setBytesPerSecond(atoi(arguments[2]));
+	log(Info, "I am listening on port %i", port);
+	
+	Memory::init();
+	Mesh* ball = loadMeshBounds("ball.obj");
+	if (ball == nullptr) {
+		log(Error, "Could not load ball.obj");
+		return 1;
+	}
+	master.setBallRadius(sphereRadius(ball, ballScale));
+	master.setContactHandler(contact);
+	// nobody sits in front of the master, so it has no ball of its own
+	master.setLocalPlayer(false);
+	Network::init(port);
+	
+	// the network thread stamps packets with System::time(), so the master keeps
+	// that clock, the steady clock only decides when to wake up and tick
+	const Clock::duration tickDuration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(tickTime));
+	const Clock::time_point start = Clock::now();
+	Clock::time_point nextTick = start;
+	lastStats = System::time();
+	while (runTime <= 0 || seconds(Clock::now() - start) < runTime) {
+		while (const Packet* packet = Network::receive()) {
+			master.receive(*packet);
+		}
+		double now = System::time();
+		master.update(now);
+		
+		int due = 0;
+		Clock::time_point tickStart = Clock::now();
+		while (tickStart >= nextTick) {
+			if (due == maxTicksPerWakeup) {
+				nextTick = tickStart + tickDuration;
+				break;
+			}
+			master.tick();
+			nextTick += tickDuration;
+			++due;
+		}
+		tickWork += Clock::now() - tickStart;
+		ticks += due;
+		logStats(now);
+		
+		// packets arriving meanwhile wait in the network thread's queue
+		std::this_thread::sleep_until(nextTick);
+	}
+	
+	Network::shutdown();
+	log(Info, "Simulation at tick %u, checksum %08x", simulation.currentTick(), simulation.checksum());
+	Memory::report();
+	if (memoryFile != nullptr) Memory::writeReport(memoryFile);
+	return 0;
+}
+
+#endif // HEADLESS
@@ -0,0 +1,22 @@
+#include "pch.h"
+
+// The Makefile's headless build leaves out Kore's system backend, which
+// brings the window, GL context and sound with it. The master only needs its
+// entry point and clock, so they are provided here instead.
+#ifdef HEADLESS_STANDALONE
+
+#include <Kore/System.h>
+#include <chrono>
+
+int kore(int argc, char** argv);
+
+double Kore::System::time() {
+	static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+	return kore(argc, argv);
+}
+
+#endif // HEADLESS_STANDALONE
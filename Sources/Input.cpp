@@ -0,0 +1,147 @@
+#include "pch.h"
+
+#include "Input.h"
+#include "BitStream.h"
+
+using namespace Kore;
+
+namespace {
+	const int inputBits = 4;
+	const int countBits = 4;
+	
+	u32 packInput(const PlayerInput& input) {
+		return (input.left ? 1 : 0) | (input.right ? 2 : 0) | (input.up ? 4 : 0) | (input.down ? 8 : 0);
+	}
+	
+	PlayerInput unpackInput(u32 bits) {
+		PlayerInput input;
+		input.left = (bits & 1) != 0;
+		input.right = (bits & 2) != 0;
+		input.up = (bits & 4) != 0;
+		input.down = (bits & 8) != 0;
+		return input;
+	}
+	
+	bool near(u32 a, u32 b) {
+		return a + 1 >= b && b + 1 >= a;
+	}
+	
+	// After a correction the prediction continues from the dequantized state, so
+	// it may land one quantization step off the master without being wrong
+	bool confirms(const QuantizedEntity& predicted, const QuantizedEntity& authoritative) {
+		if (!near(predicted.x, authoritative.x) || !near(predicted.y, authoritative.y) || !near(predicted.z, authoritative.z)) return false;
+		if (predicted.rotation == authoritative.rotation) return true;
+		Quaternion a = dequantize(predicted).rotation;
+		Quaternion b = dequantize(authoritative).rotation;
+		float dot = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+		return dot > 0.9999f || dot < -0.9999f;
+	}
+}
+
+InputHistory::InputHistory() : empty(true), newest(0), confirmed(0) {
+	for (int i = 0; i < size; ++i) ticks[i] = 0;
+}
+
+void InputHistory::record(u32 tick, const PlayerInput& input, const EntityState& state) {
+	int slot = tick % size;
+	inputs[slot] = input;
+	predicted[slot] = state;
+	ticks[slot] = tick;
+	newest = tick;
+	empty = false;
+}
+
+// Newest tick, count and the inputs from oldest to newest
+int InputHistory::write(u8* data, int capacity) const {
+	if (empty) return 0;
+	int count = 0;
+	while (count < redundancy && (u32)count < newest && ticks[(newest - count) % size] == newest - count) ++count;
+	
+	BitWriter writer(data, capacity);
+	writer.write(newest, 32);
+	writer.write(count, countBits);
+	for (int i = count - 1; i >= 0; --i) {
+		writer.write(packInput(inputs[(newest - i) % size]), inputBits);
+	}
+	return writer.overflowed() ? 0 : writer.bytes();
+}
+
+int InputHistory::reconcile(u32 tick, const QuantizedEntity& authoritative, Simulation& simulation, int player) {
+	// Older or repeated corrections are already part of the prediction, the master can not be ahead
+	if (empty || tick <= confirmed || tick > newest) return 0;
+	confirmed = tick;
+	
+	int slot = tick % size;
+	if (ticks[slot] == tick && confirms(quantize(predicted[slot]), authoritative)) return 0;
+	
+	EntityState& ball = simulation.balls[player];
+	ball = dequantize(authoritative);
+	u32 first = newest - tick >= (u32)size ? newest - size + 1 : tick + 1;
+	int replayed = 0;
+	for (u32 t = first; t <= newest; ++t) {
+		int s = t % size;
+		if (ticks[s] != t) continue;
+		simulation.movePlayer(player, inputs[s]);
+		predicted[s] = ball;
+		++replayed;
+	}
+	return replayed;
+}
+
+InputQueue::InputQueue() : started(false), next(0), newest(0), processed(false) {
+	for (int i = 0; i < size; ++i) valid[i] = false;
+}
+
+void InputQueue::read(const u8* data, int dataSize) {
+	BitReader reader(data, dataSize);
+	u32 tick = reader.read(32);
+	int count = (int)reader.read(countBits);
+	if (reader.overflowed() || count == 0 || (u32)count > tick) return;
+	
+	u32 oldest = tick - count + 1;
+	if (!started) {
+		started = true;
+		next = oldest;
+		newest = oldest;
+	}
+	for (int i = 0; i < count; ++i) {
+		u32 bits = reader.read(inputBits);
+		u32 t = oldest + i;
+		if (reader.overflowed()) return;
+		if (t < next || t - next >= (u32)size) continue;
+		int slot = t % size;
+		inputs[slot] = unpackInput(bits);
+		ticks[slot] = t;
+		valid[slot] = true;
+		if (t > newest) newest = t;
+	}
+}
+
+bool InputQueue::pop(PlayerInput& input) {
+	while (started && next <= newest) {
+		int slot = next % size;
+		if (valid[slot] && ticks[slot] == next) {
+			input = inputs[slot];
+			valid[slot] = false;
+			processed = true;
+			++next;
+			return true;
+		}
+		// Later packets repeat the input, unless it is too old for that
+		if (newest - next < (u32)InputHistory::redundancy) return false;
+		++next;
+	}
+	return false;
+}
+
+int InputQueue::queued() const {
+	return started && newest >= next ? (int)(newest - next + 1) : 0;
+}
+
+bool InputQueue::processedAny() const {
+	return processed;
+}
+
+u32 InputQueue::lastProcessed() const {
+	return next - 1;
+}
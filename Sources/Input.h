@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Simulation.h"
+
+// Slave side: the own inputs by tick and the states they were predicted to
+// lead to, kept until the master confirmed them
+class InputHistory {
+public:
+	// Also the upper bound of ticks replayed by one reconcile()
+	static const int size = 64;
+	// Every packet repeats this many of the newest inputs, so single lost packets lose nothing
+	static const int redundancy = 8;
+	
+	InputHistory();
+	
+	void record(Kore::u32 tick, const PlayerInput& input, const EntityState& predicted);
+	int write(Kore::u8* data, int capacity) const;
+	
+	// Compares the prediction for the tick with the master's state. On a mismatch
+	// the ball is reset to the master's state and the later inputs are replayed.
+	// Returns the number of replayed ticks.
+	int reconcile(Kore::u32 tick, const QuantizedEntity& authoritative, Simulation& simulation, int player);
+
+private:
+	PlayerInput inputs[size];
+	EntityState predicted[size];
+	Kore::u32 ticks[size];
+	bool empty;
+	Kore::u32 newest;
+	Kore::u32 confirmed;
+};
+
+// Master side: the inputs of a remote player in tick order
+class InputQueue {
+public:
+	static const int size = 64;
+	
+	InputQueue();
+	
+	void read(const Kore::u8* data, int size);
+	
+	// Next input in tick order, false when it did not arrive yet.
+	// Inputs that can not arrive anymore are skipped.
+	bool pop(PlayerInput& input);
+	
+	int queued() const;
+	bool processedAny() const;
+	Kore::u32 lastProcessed() const;
+
+private:
+	PlayerInput inputs[size];
+	Kore::u32 ticks[size];
+	bool valid[size];
+	bool started;
+	Kore::u32 next;
+	Kore::u32 newest;
+	bool processed;
+};
@@ -0,0 +1,355 @@
+#include "pch.h"
+
+#include "Master.h"
+#include "BitStream.h"
+
+#include <Kore/Log.h>
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+using namespace Kore;
+
+namespace {
+	// Unused budget is kept for at most this long
+	const double maxCreditTime = 0.25;
+	// Priority gained per snapshot a ball is left out, from 1 at the edge of the
+	// interest radius to 2 right at the own ball, times 4 while it moves
+	const float movingPriority = 4.0f;
+	
+	// Connections losing more packets or with a longer round trip get throttled
+	const double maxPacketLoss = 0.1;
+	const double maxRoundTripTime = 0.25;
+	const double adaptInterval = 0.5;
+	// Halved on a bad connection, back up in small steps on a good one
+	const double minQuality = 0.25;
+	const double qualityStep = 0.1;
+	// Two slave inputs are used per tick while more than this many are queued,
+	// for example when its clock runs a little faster or packets came in a burst
+	const int catchUpInputs = 4;
+	
+	struct Candidate {
+		u16 id;
+		float priority;
+	};
+	
+	bool higher(const Candidate& a, const Candidate& b) {
+		return a.priority > b.priority;
+	}
+	
+	bool readHello(const Message& message, u32& session) {
+		if (message.size != 1 + 4 || message.data[0] != Hello) return false;
+		BitReader reader(&message.data[1], message.size - 1);
+		session = reader.read(32);
+		return !reader.overflowed();
+	}
+}
+
+Master::Master(Simulation& simulation, int sendRate, int bytesPerSecond) : simulation(simulation), grid(-1, -4, 1, 4, interestRadius), contactHandler(nullptr), now(0), sendRate(sendRate), bytesPerSecond(bytesPerSecond) {
+	local = simulation.spawnPlayer();
+	for (int i = 0; i < maxClients; ++i) clients[i].used = false;
+	memset(quantized, 0, sizeof(quantized));
+	memset(&stats, 0, sizeof(stats));
+}
+
+void Master::setSendRate(int sendRate) {
+	this->sendRate = sendRate;
+}
+
+void Master::setBytesPerSecond(int bytesPerSecond) {
+	this->bytesPerSecond = bytesPerSecond;
+}
+
+void Master::setContactHandler(ContactHandler handler) {
+	contactHandler = handler;
+}
+
+void Master::setBallRadius(float radius) {
+	collisions.setRadius(radius);
+}
+
+int Master::localBall() const {
+	return local;
+}
+
+void Master::setLocalPlayer(bool enabled) {
+	if (!enabled && local >= 0) {
+		simulation.remove(local);
+		local = -1;
+	}
+	if (enabled && local < 0) local = simulation.spawnPlayer();
+}
+
+Master::Client* Master::find(unsigned address, int port) {
+	for (int i = 0; i < maxClients; ++i) {
+		Client& client = clients[i];
+		if (client.used && client.address == address && client.port == port) return &client;
+	}
+	return nullptr;
+}
+
+Master::Client* Master::add(unsigned address, int port, u32 session) {
+	Client* unused = nullptr;
+	for (int i = 0; i < maxClients && unused == nullptr; ++i) {
+		if (!clients[i].used) unused = &clients[i];
+	}
+	if (unused == nullptr) return nullptr;
+	
+	unused->used = true;
+	unused->address = address;
+	unused->port = port;
+	unused->session = session;
+	unused->ball = -1;
+	unused->lastReceived = now;
+	unused->sendCredit = 0;
+	unused->sendTimer = 0;
+	unused->quality = 1;
+	unused->lastAdapted = now;
+	for (int i = 0; i < maxEntities; ++i) unused->priority[i] = 0;
+	unused->connection = Connection();
+	unused->connection.init(address, port);
+	unused->connection.update(now);
+	unused->inputs = InputQueue();
+	unused->snapshots = SnapshotSender();
+	// no packet ends up in a slot that does not match its number
+	for (int i = 0; i < snapshotHistorySize; ++i) unused->sent[i].packet = (u16)(i + 1);
+	return unused;
+}
+
+bool Master::join(Client& client) {
+	client.ball = simulation.spawnPlayer();
+	if (client.ball < 0) {
+		// the slot is freed, the slave says hello again once it gave up on us
+		log(Warning, "No room for another player");
+		drop(client, "rejected");
+		return false;
+	}
+	
+	QuantizedEntity state = quantize(simulation.balls[client.ball]);
+	u8 data[1 + 2 + 4 * 4];
+	BitWriter writer(data, sizeof(data));
+	writer.write(Welcome, 8);
+	writer.write(client.ball, 16);
+	writer.write(state.x, 32);
+	writer.write(state.y, 32);
+	writer.write(state.z, 32);
+	writer.write(state.rotation, 32);
+	client.connection.sendReliable(data, writer.bytes());
+	log(Info, "Player %i joined, %i clients", client.ball, clientCount());
+	return true;
+}
+
+void Master::drop(Client& client, const char* reason) {
+	if (client.ball >= 0) {
+		simulation.remove(client.ball);
+		log(Info, "Player %i %s", client.ball, reason);
+	}
+	client.used = false;
+}
+
+void Master::receive(const Packet& packet) {
+	Message first;
+	u32 session = 0;
+	bool hello = Connection::firstMessage(packet, first) && readHello(first, session);
+	
+	Client* client = find(packet.address, packet.port);
+	if (client != nullptr && hello && client->session != session) {
+		// the slave gave up on us and connected again, resent hellos carry the old session
+		drop(*client, "reconnected");
+		client = nullptr;
+	}
+	// strangers only get a slot for a hello, not for stray packets or port scans
+	if (client == nullptr) {
+		if (!hello) return;
+		client = add(packet.address, packet.port, session);
+		if (client == nullptr) return;
+	}
+	client->lastReceived = packet.time;
+	client->connection.receive(packet);
+	Message message;
+	while (client->connection.nextMessage(message)) {
+		if (message.size == 0) continue;
+		if (message.data[0] == Hello && client->ball < 0 && !join(*client)) return;
+		if (message.data[0] == PlayerInputs) {
+			client->inputs.read(&message.data[1], message.size - 1);
+		}
+	}
+}
+
+void Master::update(double now) {
+	this->now = now;
+	for (int i = 0; i < maxClients; ++i) {
+		Client& client = clients[i];
+		if (!client.used) continue;
+		if (now - client.lastReceived > clientTimeout) {
+			drop(client, "timed out");
+			continue;
+		}
+		client.connection.update(now);
+		adapt(client);
+		u16 packet;
+		while (client.connection.nextAcked(packet)) {
+			const SentSnapshot& sent = client.sent[packet % snapshotHistorySize];
+			if (sent.packet == packet) client.snapshots.acknowledge(sent.snapshot);
+		}
+	}
+}
+
+// Multiplicative decrease, additive increase, like tcp but per half second instead of per packet
+void Master::adapt(Client& client) {
+	if (now - client.lastAdapted < adaptInterval) return;
+	client.lastAdapted = now;
+	if (client.connection.packetLoss() > maxPacketLoss || client.connection.roundTripTime() > maxRoundTripTime) {
+		client.quality = std::max(minQuality, client.quality * 0.5);
+	}
+	else {
+		client.quality = std::min(1.0, client.quality + qualityStep);
+	}
+}
+
+void Master::tick(const PlayerInput& localInput) {
+	simulation.beginTick();
+	if (local >= 0) simulation.movePlayer(local, localInput);
+	for (int i = 0; i < maxClients; ++i) {
+		Client& client = clients[i];
+		if (!client.used || client.ball < 0) continue;
+		// a slave's ball only moves with the slave's inputs, so its prediction stays valid
+		int moves = client.inputs.queued() > catchUpInputs ? 2 : 1;
+		PlayerInput input;
+		for (int move = 0; move < moves && client.inputs.pop(input); ++move) {
+			simulation.movePlayer(client.ball, input);
+		}
+	}
+	simulation.endTick();
+	if (contactHandler != nullptr) detectContacts();
+	
+	bool prepared = false;
+	for (int i = 0; i < maxClients; ++i) {
+		Client& client = clients[i];
+		if (!client.used || client.ball < 0) continue;
+		double bytes = bytesPerSecond * client.quality;
+		client.sendCredit = std::min(client.sendCredit + bytes * tickTime, bytes * maxCreditTime);
+		client.sendTimer -= tickTime;
+		if (client.sendTimer > 0) continue;
+		client.sendTimer = std::max(0.0, client.sendTimer + 1.0 / (sendRate * client.quality));
+		if (!prepared) {
+			prepareSnapshots();
+			prepared = true;
+		}
+		sendSnapshot(client);
+	}
+}
+
+// The handler may move balls, so the contacts are all found before the first is handed out
+void Master::detectContacts() {
+	// once for every ball there can be, instead of again whenever a player joins
+	collisions.reserve(Simulation::maxBalls);
+	int ids[Simulation::maxBalls];
+	int count = 0;
+	for (int i = 0; i < Simulation::maxBalls; ++i) {
+		if (simulation.isActive(i)) ids[count++] = i;
+	}
+	Contact contacts[maxContacts];
+	int contactCount = collisions.detect(simulation.balls, ids, count, contacts, maxContacts);
+	for (int i = 0; i < contactCount; ++i) contactHandler(contacts[i]);
+}
+
+void Master::prepareSnapshots() {
+	grid.build(simulation);
+	for (int i = 0; i < Simulation::maxBalls; ++i) {
+		if (!simulation.isActive(i)) continue;
+		QuantizedEntity entity = quantize(simulation.balls[i]);
+		moved[i] = memcmp(&entity, &quantized[i], sizeof(entity)) != 0;
+		quantized[i] = entity;
+	}
+}
+
+void Master::sendSnapshot(Client& client) {
+	const EntityState& center = simulation.balls[client.ball];
+	u16 ids[maxEntities];
+	int count = grid.query(center.x, center.y, interestRadius, ids, maxEntities);
+	Candidate candidates[maxEntities];
+	for (int i = 0; i < count; ++i) {
+		u16 id = ids[i];
+		const EntityState& ball = simulation.balls[id];
+		float dx = ball.x - center.x, dy = ball.y - center.y;
+		float gain = 2.0f - sqrtf(dx * dx + dy * dy) / interestRadius;
+		if (moved[id]) gain *= movingPriority;
+		client.priority[id] += gain;
+		candidates[i].id = id;
+		// the slave needs its own ball in every snapshot to confirm its prediction
+		candidates[i].priority = id == client.ball ? HUGE_VALF : client.priority[id];
+	}
+	std::sort(candidates, candidates + count, higher);
+	
+	// as many as fit into the budget and one datagram, unchanged balls only take a few bits
+	int budget = std::min((int)client.sendCredit, (int)Connection::maxMessageSize);
+	int bits = (budget - 1) * 8 - SnapshotSender::headerBits;
+	int selected = 0;
+	for (int i = 0; i < count && selected < maxSnapshotEntities; ++i) {
+		u16 id = candidates[i].id;
+		int entityBits = client.snapshots.entityBits(id, quantized[id]);
+		if (entityBits > bits) {
+			// over budget, the slave extrapolates a little longer
+			if (id == client.ball) return;
+			continue;
+		}
+		bits -= entityBits;
+		ids[selected++] = id;
+	}
+	count = selected;
+	// the delta compression walks the ids in ascending order
+	std::sort(ids, ids + count);
+	
+	Snapshot snapshot;
+	snapshot.time = simulation.currentTick() * tickTime;
+	snapshot.hasProcessedInput = client.inputs.processedAny();
+	snapshot.processedInput = client.inputs.lastProcessed();
+	snapshot.count = count;
+	for (int i = 0; i < count; ++i) {
+		snapshot.ids[i] = ids[i];
+		snapshot.entities[i] = quantized[ids[i]];
+	}
+	
+	u8 data[Packet::maxSize];
+	data[0] = (u8)StateSnapshot;
+	int size = client.snapshots.write(snapshot, &data[1], Connection::maxMessageSize - 1);
+	if (size == 0) return;
+	u16 packet = client.connection.sendUnreliable(data, 1 + size);
+	client.sent[packet % snapshotHistorySize].packet = packet;
+	client.sent[packet % snapshotHistorySize].snapshot = snapshot.sequence;
+	client.sendCredit -= 1 + size;
+	for (int i = 0; i < count; ++i) client.priority[ids[i]] = 0;
+	
+	++stats.snapshots;
+	stats.snapshotBytes += 1 + size;
+	stats.rawSnapshotBytes += 1 + snapshot.count * 7 * sizeof(float);
+}
+
+int Master::clientCount() const {
+	int count = 0;
+	for (int i = 0; i < maxClients; ++i) {
+		if (clients[i].used && clients[i].ball >= 0) ++count;
+	}
+	return count;
+}
+
+NetworkStats Master::takeStats() {
+	NetworkStats result = stats;
+	int connections = 0;
+	for (int i = 0; i < maxClients; ++i) {
+		if (!clients[i].used) continue;
+		result.resentMessages += clients[i].connection.resentMessages();
+		result.roundTripTime += clients[i].connection.roundTripTime();
+		result.packetLoss += clients[i].connection.packetLoss();
+		result.sendRate += sendRate * clients[i].quality;
+		++connections;
+	}
+	if (connections > 0) {
+		result.roundTripTime /= connections;
+		result.packetLoss /= connections;
+		result.sendRate /= connections;
+	}
+	memset(&stats, 0, sizeof(stats));
+	return result;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "Collisions.h"
+#include "Connection.h"
+#include "Input.h"
+#include "Protocol.h"
+#include "Simulation.h"
+#include "SpatialGrid.h"
+
+// Runs the authoritative simulation for the local player and every slave that
+// said hello. Clients are identified by the address and port their packets
+// come from, only a hello gets an address a client slot. Each one only gets
+// the balls near its own, limited by a per-client byte budget, so the bytes
+// sent to one client do not grow with the number of players.
+//
+// Every client has a priority per ball that grows while the ball is left out,
+// faster for near and moving balls. Each snapshot takes the balls with the
+// highest priorities that fit into the client's budget and one datagram.
+// Clients losing packets or lagging get fewer and smaller snapshots until
+// their connection recovers.
+class Master {
+public:
+	static const int maxClients = 128;
+	static const int maxContacts = 256;
+	// Balls further away from a client's own ball are not sent to it
+	static constexpr float interestRadius = 2.5f;
+	
+	// Snapshots per second and bytes per second for every client, at most the tick rate
+	Master(Simulation& simulation, int sendRate = 30, int bytesPerSecond = 8000);
+	
+	void setSendRate(int sendRate);
+	void setBytesPerSecond(int bytesPerSecond);
+	
+	// While set, the balls are tested for contacts after every tick and the
+	// function decides what they mean for the game
+	typedef void (*ContactHandler)(const Contact& contact);
+	void setContactHandler(ContactHandler handler);
+	// Taken from the bounds of the ball mesh
+	void setBallRadius(float radius);
+	
+	// Ball of the player in front of the master's window, -1 without one
+	int localBall() const;
+	// On by default, a master without a window turns it off so there is no
+	// ball nobody moves. Call before the first tick.
+	void setLocalPlayer(bool enabled);
+	
+	void receive(const Packet& packet);
+	// Call once per frame before ticking
+	void update(double now);
+	// The input is ignored without a local player
+	void tick(const PlayerInput& localInput = PlayerInput());
+	
+	int clientCount() const;
+	NetworkStats takeStats();
+
+private:
+	struct SentSnapshot {
+		Kore::u16 packet;
+		Kore::u16 snapshot;
+	};
+	
+	struct Client {
+		bool used;
+		unsigned address;
+		int port;
+		// Chosen by the slave on every connect
+		Kore::u32 session;
+		// -1 until the hello arrived
+		int ball;
+		double lastReceived;
+		// Bytes the client may still get, refilled every tick
+		double sendCredit;
+		// Time until the next snapshot
+		double sendTimer;
+		// Share of the send rate and byte budget the connection can take, lowered on loss and lag
+		double quality;
+		double lastAdapted;
+		float priority[maxEntities];
+		Connection connection;
+		InputQueue inputs;
+		SnapshotSender snapshots;
+		// Which snapshot went out in which packet, the packet acks tell the snapshot acks
+		SentSnapshot sent[snapshotHistorySize];
+	};
+	
+	Client* find(unsigned address, int port);
+	Client* add(unsigned address, int port, Kore::u32 session);
+	// False when there is no room, the client is dropped then
+	bool join(Client& client);
+	void drop(Client& client, const char* reason);
+	void adapt(Client& client);
+	void prepareSnapshots();
+	void sendSnapshot(Client& client);
+	void detectContacts();
+	
+	Simulation& simulation;
+	SpatialGrid grid;
+	Collisions collisions;
+	ContactHandler contactHandler;
+	int local;
+	double now;
+	int sendRate;
+	int bytesPerSecond;
+	Client clients[maxClients];
+	// All balls quantized once per tick in which any client gets a snapshot, shared by every client
+	QuantizedEntity quantized[maxEntities];
+	bool moved[maxEntities];
+	NetworkStats stats;
+};
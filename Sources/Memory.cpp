@@ -2,30 +2,252 @@
 
 #include "Memory.h"
 
+#include <Kore/Log.h>
 #include <assert.h>
+#include <stdio.h>
 
 using namespace Kore;
 
+LinearAllocator::LinearAllocator() : memory(nullptr), size(0), offset(0) {}
+
+void LinearAllocator::init(void* memory, size_t size) {
+	this->memory = (char*)memory;
+	this->size = size;
+	offset = 0;
+}
+
+void* LinearAllocator::allocate(size_t size, size_t align) {
+	assert(align != 0 && (align & (align - 1)) == 0);
+	size_t current = offset.load();
+	size_t start, end;
+	// The alignment is of the address, so blocks and alignments of any size work
+	do {
+		size_t address = (size_t)memory + current;
+		start = ((address + align - 1) & ~(align - 1)) - (size_t)memory;
+		end = start + size;
+		if (end > this->size) return nullptr;
+	} while (!offset.compare_exchange_weak(current, end));
+	return &memory[start];
+}
+
+size_t LinearAllocator::mark() const {
+	return offset.load();
+}
+
+void LinearAllocator::release(size_t marker) {
+	assert(marker <= offset.load());
+	offset.store(marker);
+}
+
+void LinearAllocator::reset() {
+	offset.store(0);
+}
+
+size_t LinearAllocator::used() const {
+	return offset.load();
+}
+
 namespace {
-	const size_t memorySize = 10 * 1024 * 1024;
-	const size_t scratchPadSize = 4 * 1024 * 1024;
+	const int maxScratchPads = 8;
+	// Only for small temporaries, the mesh loaders grow their own arrays
+	const size_t scratchPadSize = 64 * 1024;
+	const size_t scratchPadsSize = maxScratchPads * scratchPadSize;
+	// Thread arenas grab this much from the main allocator at once
+	const size_t chunkSize = 256 * 1024;
+	// Bigger allocations go straight to the main allocator so little of a chunk is wasted
+	const size_t maxLocalSize = chunkSize / 4;
+	
 	u8* memory;
-	size_t index;
+	// Loader threads allocate concurrently
+	LinearAllocator main;
+	// Only used by the game loop
+	LinearAllocator frame;
+	
+	std::atomic<bool> scratchPadUsed[maxScratchPads];
+	
+	const char* tagNames[MemoryTagCount] = { "general", "mesh", "frame" };
+	
+	struct TagUsage {
+		std::atomic<size_t> live;
+		std::atomic<size_t> peak;
+		std::atomic<size_t> allocations;
+	};
+	
+	TagUsage usage[MemoryTagCount];
+	size_t mainBlockSize;
+	size_t frameBlockSize;
+	std::atomic<size_t> mainPeak(0);
+	std::atomic<size_t> framePeak(0);
+	std::atomic<size_t> largestScratchPad(0);
+	// Threads that found no free scratch pad
+	std::atomic<int> extraScratchPads(0);
+	
+	// The live bytes at every mark(), put back by release()
+	const int maxMarks = 16;
+	
+	struct Mark {
+		size_t marker;
+		size_t live[MemoryTagCount];
+	};
+	
+	Mark marks[maxMarks];
+	int markCount = 0;
+	// Counts the release() calls, a thread arena whose chunk is from an older
+	// generation might hold memory that was given back and takes a new one
+	std::atomic<unsigned> generation(0);
+	
+	struct ThreadScratchPad {
+		int slot;
+		void* data;
+		
+		ThreadScratchPad() : slot(-1), data(nullptr) {}
+		
+		~ThreadScratchPad() {
+			if (slot >= 0) scratchPadUsed[slot].store(false);
+		}
+	};
+	
+	struct ThreadArena {
+		LinearAllocator chunk;
+		unsigned generation;
+		bool valid;
+		
+		ThreadArena() : generation(0), valid(false) {}
+	};
+	
+	thread_local ThreadScratchPad threadScratchPad;
+	thread_local ThreadArena threadArena;
+	
+	void raise(std::atomic<size_t>& peak, size_t value) {
+		size_t current = peak.load();
+		while (value > current && !peak.compare_exchange_weak(current, value)) {}
+	}
+	
+	void track(MemoryTag tag, size_t size) {
+		TagUsage& tagUsage = usage[tag];
+		raise(tagUsage.peak, tagUsage.live.fetch_add(size) + size);
+		++tagUsage.allocations;
+	}
+	
+	void* allocateMain(size_t size, size_t align) {
+		void* data = main.allocate(size, align);
+		assert(data != nullptr);
+		raise(mainPeak, main.used());
+		return data;
+	}
 }
 
-void Memory::init() {
-	memory = new u8[memorySize];
-	index = scratchPadSize;
+void Memory::init(size_t size, size_t frameSize) {
+	assert(size > scratchPadsSize + frameSize);
+	memory = new u8[size];
+	frameBlockSize = frameSize;
+	mainBlockSize = size - scratchPadsSize - frameSize;
+	frame.init(&memory[scratchPadsSize], frameSize);
+	main.init(&memory[scratchPadsSize + frameSize], mainBlockSize);
 }
 
 void* Memory::scratchPad(size_t size) {
-	assert(size < scratchPadSize);
-	return memory;
+	assert(size <= scratchPadSize);
+	raise(largestScratchPad, size);
+	ThreadScratchPad& pad = threadScratchPad;
+	if (pad.data != nullptr) return pad.data;
+	
+	for (int i = 0; i < maxScratchPads; ++i) {
+		bool expected = false;
+		if (scratchPadUsed[i].compare_exchange_strong(expected, true)) {
+			pad.slot = i;
+			pad.data = &memory[i * scratchPadSize];
+			return pad.data;
+		}
+	}
+	// More threads than scratch pads, this one keeps a piece of the main allocator
+	++extraScratchPads;
+	pad.data = allocateMain(scratchPadSize, defaultAlignment);
+	return pad.data;
 }
 
-void* Memory::allocate(size_t size) {
-	assert(index + size < memorySize);
-	void* data = &memory[index];
-	index += size;
+void* Memory::allocate(size_t size, MemoryTag tag, size_t align) {
+	track(tag, size);
+	return allocateMain(size, align);
+}
+
+void* Memory::allocateLocal(size_t size, MemoryTag tag, size_t align) {
+	if (size > maxLocalSize || align > maxLocalSize) return allocate(size, tag, align);
+	track(tag, size);
+	ThreadArena& arena = threadArena;
+	unsigned current = generation.load();
+	if (arena.valid && arena.generation == current) {
+		void* data = arena.chunk.allocate(size, align);
+		if (data != nullptr) return data;
+	}
+	
+	// The only step that touches shared state, the compare and swap in the main allocator
+	arena.chunk.init(allocateMain(chunkSize, defaultAlignment), chunkSize);
+	arena.generation = current;
+	arena.valid = true;
+	return arena.chunk.allocate(size, align);
+}
+
+size_t Memory::mark() {
+	assert(markCount < maxMarks);
+	Mark& mark = marks[markCount++];
+	mark.marker = main.mark();
+	for (int i = 0; i < MemoryTagCount; ++i) mark.live[i] = usage[i].live.load();
+	return mark.marker;
+}
+
+void Memory::release(size_t marker) {
+	// marks above this one were never released, they are gone with it
+	while (markCount > 0 && marks[markCount - 1].marker > marker) --markCount;
+	if (markCount > 0 && marks[markCount - 1].marker == marker) {
+		const Mark& mark = marks[--markCount];
+		for (int i = 0; i < MemoryTagCount; ++i) {
+			if (i != FrameMemory) usage[i].live.store(mark.live[i]);
+		}
+	}
+	++generation;
+	main.release(marker);
+}
+
+void* Memory::allocateFrame(size_t size, size_t align) {
+	track(FrameMemory, size);
+	void* data = frame.allocate(size, align);
+	assert(data != nullptr);
 	return data;
 }
+
+void Memory::endFrame() {
+	raise(framePeak, frame.used());
+	usage[FrameMemory].live.store(0);
+	frame.reset();
+}
+
+void Memory::report() {
+	raise(framePeak, frame.used());
+	log(Info, "Memory main block: %llu of %llu bytes at the peak", (unsigned long long)mainPeak.load(), (unsigned long long)mainBlockSize);
+	log(Info, "Memory frame block: %llu of %llu bytes at the peak", (unsigned long long)framePeak.load(), (unsigned long long)frameBlockSize);
+	log(Info, "Memory scratch pads: largest request %llu of %llu bytes, %i threads without a pad", (unsigned long long)largestScratchPad.load(), (unsigned long long)scratchPadSize, extraScratchPads.load());
+	for (int i = 0; i < MemoryTagCount; ++i) {
+		log(Info, "Memory %-8s %10llu bytes live, %10llu peak, %8llu allocations", tagNames[i], (unsigned long long)usage[i].live.load(), (unsigned long long)usage[i].peak.load(), (unsigned long long)usage[i].allocations.load());
+	}
+}
+
+bool Memory::writeReport(const char* filename) {
+	FILE* file = fopen(filename, "w");
+	if (file == nullptr) {
+		log(Warning, "Could not write the memory report %s", filename);
+		return false;
+	}
+	raise(framePeak, frame.used());
+	fprintf(file, "{\n\t\"blocks\": {\n");
+	fprintf(file, "\t\t\"main\": { \"size\": %llu, \"peak\": %llu },\n", (unsigned long long)mainBlockSize, (unsigned long long)mainPeak.load());
+	fprintf(file, "\t\t\"frame\": { \"size\": %llu, \"peak\": %llu },\n", (unsigned long long)frameBlockSize, (unsigned long long)framePeak.load());
+	fprintf(file, "\t\t\"scratchPad\": { \"size\": %llu, \"peak\": %llu, \"pads\": %i, \"extraPads\": %i }\n", (unsigned long long)scratchPadSize, (unsigned long long)largestScratchPad.load(), maxScratchPads, extraScratchPads.load());
+	fprintf(file, "\t},\n\t\"tags\": {\n");
+	for (int i = 0; i < MemoryTagCount; ++i) {
+		fprintf(file, "\t\t\"%s\": { \"live\": %llu, \"peak\": %llu, \"allocations\": %llu }%s\n", tagNames[i], (unsigned long long)usage[i].live.load(), (unsigned long long)usage[i].peak.load(), (unsigned long long)usage[i].allocations.load(), i + 1 < MemoryTagCount ? "," : "");
+	}
+	fprintf(file, "\t}\n}\n");
+	fclose(file);
+	return true;
+}
@@ -1,19 +1,91 @@
 #pragma once
 
+#include <atomic>
 #include <stdlib.h>
 
+// Hands out aligned pieces of one fixed block by bumping an offset. Nothing
+// is freed one by one: release() goes back to a mark() and reset() empties
+// the whole block. Allocating is thread safe, releasing is not.
+class LinearAllocator {
+public:
+	LinearAllocator();
+	
+	void init(void* memory, size_t size);
+	
+	// Returns nullptr when the block is used up
+	void* allocate(size_t size, size_t align);
+	
+	size_t mark() const;
+	void release(size_t marker);
+	void reset();
+	
+	size_t used() const;
+
+private:
+	char* memory;
+	size_t size;
+	std::atomic<size_t> offset;
+};
+
+// What an allocation is for, the usage of every tag is tracked
+enum MemoryTag {
+	GeneralMemory,
+	MeshMemory,
+	// Everything from allocateFrame()
+	FrameMemory,
+	MemoryTagCount
+};
+
+// One block allocated at startup, split into the scratch pads, the frame
+// allocator and the main allocator that holds everything else.
 namespace Memory {
-	void init();
+	// Enough for SSE vectors and matrices
+	const size_t defaultAlignment = 16;
 	
-	void* allocate(size_t size);
+	void init(size_t size = 10 * 1024 * 1024, size_t frameSize = 1024 * 1024);
 	
-	template<class T> T* allocate(size_t count = 1) {
-		return (T*)allocate(count * sizeof(T));
+	// The main allocator is a stack: level-scoped data goes on top after a
+	// mark() and is given back all at once by release(marker), which also
+	// takes the released allocations out of the usage of their tags
+	void* allocate(size_t size, MemoryTag tag, size_t align = defaultAlignment);
+	
+	template<class T> T* allocate(MemoryTag tag, size_t count = 1, size_t align = defaultAlignment) {
+		return (T*)allocate(count * sizeof(T), tag, align);
 	}
 	
+	// For worker threads: small allocations come from a chunk only the calling
+	// thread uses, a new chunk is grabbed from the main allocator when it runs
+	// out. Lives as long as allocate() memory, release() also drops the chunks.
+	void* allocateLocal(size_t size, MemoryTag tag, size_t align = defaultAlignment);
+	
+	template<class T> T* allocateLocal(MemoryTag tag, size_t count = 1, size_t align = defaultAlignment) {
+		return (T*)allocateLocal(count * sizeof(T), tag, align);
+	}
+	
+	size_t mark();
+	void release(size_t marker);
+	
+	// Valid until the next endFrame(), for temporary data of the game loop
+	void* allocateFrame(size_t size, size_t align = defaultAlignment);
+	
+	template<class T> T* allocateFrame(size_t count = 1, size_t align = defaultAlignment) {
+		return (T*)allocateFrame(count * sizeof(T), align);
+	}
+	
+	// Call at the end of every update()
+	void endFrame();
+	
+	// Every thread gets its own scratch pad of up to 64 KB, held until the thread
+	// ends. The data stays valid until the same thread uses its scratch pad again.
 	void* scratchPad(size_t size);
 	
 	template<class T> T* scratchPad(size_t count = 1) {
 		return (T*)scratchPad(count * sizeof(T));
 	}
+	
+	// Live bytes, peak bytes and allocation count per tag plus the peak usage of
+	// every block, to size them from measurements
+	void report();
+	// The same as JSON, returns false when the file could not be written
+	bool writeReport(const char* filename);
 }
@@ -0,0 +1,275 @@
+#include "pch.h"
+
+#include "MeshCache.h"
+#include "Memory.h"
+
+#include <Kore/Log.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef SYS_WINDOWS
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace Kore;
+
+namespace {
+	const char magic[4] = { 'K', 'M', 'S', 'H' };
+	const u32 version = 2;
+	
+	// All blocks start at 16 byte aligned offsets from the (page aligned) mapping
+	struct MeshFileHeader {
+		char magic[4];
+		u32 version;
+		u64 sourceSize;
+		u64 sourceTime;
+		s32 numVertices;
+		s32 numIndices;
+		s32 numUVs;
+		s32 numNormals;
+		float minx, miny, minz;
+		float maxx, maxy, maxz;
+		u32 vertexOffset;
+		u32 indexOffset;
+		u32 uvOffset;
+		u32 normalOffset;
+	};
+	
+	u32 align(u32 offset) {
+		return (offset + 15) & ~15u;
+	}
+	
+	bool sourceInfo(const char* filename, u64& size, u64& time) {
+		struct stat info;
+		if (stat(filename, &info) != 0) return false;
+		size = (u64)info.st_size;
+		time = (u64)info.st_mtime;
+		return true;
+	}
+	
+	void cacheName(const char* filename, char* name, size_t length) {
+		snprintf(name, length, "%s.kmesh", filename);
+	}
+	
+	// Per process, so masters started side by side never write into the same file
+	void temporaryName(const char* name, char* temporary, size_t length) {
+#ifdef SYS_WINDOWS
+		snprintf(temporary, length, "%s.tmp.%lu", name, (unsigned long)GetCurrentProcessId());
+#else
+		snprintf(temporary, length, "%s.tmp.%ld", name, (long)getpid());
+#endif
+	}
+	
+	// Readers that still have the old cache mapped keep its (unlinked) contents
+	bool replaceFile(const char* from, const char* to) {
+#ifdef SYS_WINDOWS
+		return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		return rename(from, to) == 0;
+#endif
+	}
+	
+	const void* mapFile(const char* filename, size_t& size) {
+#ifdef SYS_WINDOWS
+		HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) return nullptr;
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(MeshFileHeader)) {
+			CloseHandle(file);
+			return nullptr;
+		}
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(file);
+		if (mapping == nullptr) return nullptr;
+		const void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+		size = (size_t)fileSize.QuadPart;
+		return data;
+#else
+		int file = open(filename, O_RDONLY);
+		if (file < 0) return nullptr;
+		struct stat info;
+		if (fstat(file, &info) != 0 || info.st_size < (off_t)sizeof(MeshFileHeader)) {
+			close(file);
+			return nullptr;
+		}
+		void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		close(file);
+		if (data == MAP_FAILED) return nullptr;
+		size = (size_t)info.st_size;
+		return data;
+#endif
+	}
+	
+	void unmapFile(const void* data, size_t size) {
+#ifdef SYS_WINDOWS
+		(void)size;
+		UnmapViewOfFile(data);
+#else
+		munmap((void*)data, size);
+#endif
+	}
+	
+	bool blockFits(u32 offset, size_t count, size_t elementSize, size_t fileSize) {
+		return offset % 16 == 0 && offset <= fileSize && count * elementSize <= fileSize - offset;
+	}
+	
+	// The returned mesh points straight into the mapping, which therefore stays mapped
+	Mesh* openCache(const char* name, bool haveSource, u64 sourceSize, u64 sourceTime) {
+		size_t size;
+		const u8* data = (const u8*)mapFile(name, size);
+		if (data == nullptr) return nullptr;
+		
+		const MeshFileHeader* header = (const MeshFileHeader*)data;
+		bool valid = memcmp(header->magic, magic, sizeof(magic)) == 0 && header->version == version
+			&& header->numVertices >= 0 && header->numIndices >= 0 && header->numUVs >= 0 && header->numNormals >= 0
+			&& blockFits(header->vertexOffset, header->numVertices, 8 * sizeof(float), size)
+			&& blockFits(header->indexOffset, header->numIndices, sizeof(int), size)
+			&& blockFits(header->uvOffset, header->numUVs, 2 * sizeof(float), size)
+			&& blockFits(header->normalOffset, header->numNormals, 3 * sizeof(float), size);
+		if (valid && haveSource) {
+			valid = header->sourceSize == sourceSize && header->sourceTime == sourceTime;
+		}
+		if (!valid) {
+			unmapFile(data, size);
+			return nullptr;
+		}
+		
+		Mesh* mesh = Memory::allocateLocal<Mesh>(MeshMemory);
+		mesh->numVertices = header->numVertices;
+		mesh->numIndices = header->numIndices;
+		mesh->numFaces = header->numIndices / 3;
+		mesh->numUVs = header->numUVs;
+		mesh->numNormals = header->numNormals;
+		mesh->vertices = (float*)(data + header->vertexOffset);
+		mesh->indices = (int*)(data + header->indexOffset);
+		mesh->uvs = (float*)(data + header->uvOffset);
+		mesh->normals = (float*)(data + header->normalOffset);
+		mesh->minx = header->minx;
+		mesh->miny = header->miny;
+		mesh->minz = header->minz;
+		mesh->maxx = header->maxx;
+		mesh->maxy = header->maxy;
+		mesh->maxz = header->maxz;
+		return mesh;
+	}
+	
+	bool readBounds(const char* name, bool haveSource, u64 sourceSize, u64 sourceTime, Mesh* mesh) {
+		FILE* file = fopen(name, "rb");
+		if (file == nullptr) return false;
+		MeshFileHeader header;
+		bool valid = fread(&header, sizeof(header), 1, file) == 1;
+		fclose(file);
+		valid = valid && memcmp(header.magic, magic, sizeof(magic)) == 0 && header.version == version;
+		if (valid && haveSource) {
+			valid = header.sourceSize == sourceSize && header.sourceTime == sourceTime;
+		}
+		if (!valid) return false;
+		mesh->minx = header.minx;
+		mesh->miny = header.miny;
+		mesh->minz = header.minz;
+		mesh->maxx = header.maxx;
+		mesh->maxy = header.maxy;
+		mesh->maxz = header.maxz;
+		return true;
+	}
+	
+	void writeBlock(FILE* file, u32 offset, const void* data, size_t size) {
+		fseek(file, offset, SEEK_SET);
+		if (size > 0) fwrite(data, 1, size, file);
+	}
+	
+	bool writeCache(const char* name, const Mesh* mesh, u64 sourceSize, u64 sourceTime) {
+		MeshFileHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, magic, sizeof(magic));
+		header.version = version;
+		header.sourceSize = sourceSize;
+		header.sourceTime = sourceTime;
+		header.numVertices = mesh->numVertices;
+		header.numIndices = mesh->numIndices;
+		header.numUVs = mesh->numUVs;
+		header.numNormals = mesh->numNormals;
+		header.minx = mesh->minx;
+		header.miny = mesh->miny;
+		header.minz = mesh->minz;
+		header.maxx = mesh->maxx;
+		header.maxy = mesh->maxy;
+		header.maxz = mesh->maxz;
+		header.vertexOffset = align(sizeof(MeshFileHeader));
+		header.indexOffset = align(header.vertexOffset + mesh->numVertices * 8 * sizeof(float));
+		header.uvOffset = align(header.indexOffset + mesh->numIndices * sizeof(int));
+		header.normalOffset = align(header.uvOffset + mesh->numUVs * 2 * sizeof(float));
+		u32 end = align(header.normalOffset + mesh->numNormals * 3 * sizeof(float));
+		
+		// written next to the cache and renamed over it once complete, nobody sees a torn file
+		// room for the cache name, ".tmp." and any pid
+		char temporary[1024 + 32];
+		temporaryName(name, temporary, sizeof(temporary));
+		FILE* file = fopen(temporary, "wb");
+		if (file == nullptr) return false;
+		writeBlock(file, 0, &header, sizeof(header));
+		writeBlock(file, header.vertexOffset, mesh->vertices, mesh->numVertices * 8 * sizeof(float));
+		writeBlock(file, header.indexOffset, mesh->indices, mesh->numIndices * sizeof(int));
+		writeBlock(file, header.uvOffset, mesh->uvs, mesh->numUVs * 2 * sizeof(float));
+		writeBlock(file, header.normalOffset, mesh->normals, mesh->numNormals * 3 * sizeof(float));
+		
+		// empty trailing blocks still have to lie inside the file to pass blockFits
+		const char padding[16] = {};
+		fseek(file, 0, SEEK_END);
+		long written = ftell(file);
+		if (written >= 0 && (u32)written < end) fwrite(padding, 1, end - (u32)written, file);
+		
+		bool success = ferror(file) == 0;
+		success = fflush(file) == 0 && success;
+		success = fclose(file) == 0 && success;
+		success = success && replaceFile(temporary, name);
+		if (!success) remove(temporary);
+		return success;
+	}
+}
+
+Mesh* loadMesh(const char* filename) {
+	char name[1024];
+	cacheName(filename, name, sizeof(name));
+	
+	u64 sourceSize = 0, sourceTime = 0;
+	bool haveSource = sourceInfo(filename, sourceSize, sourceTime);
+	
+	Mesh* mesh = openCache(name, haveSource, sourceSize, sourceTime);
+	if (mesh != nullptr) return mesh;
+	
+	mesh = loadObj(filename);
+	if (haveSource && !writeCache(name, mesh, sourceSize, sourceTime)) {
+		log(Warning, "Could not write mesh cache %s", name);
+	}
+	return mesh;
+}
+
+Mesh* loadMeshBounds(const char* filename) {
+	char name[1024];
+	cacheName(filename, name, sizeof(name));
+	
+	u64 sourceSize = 0, sourceTime = 0;
+	bool haveSource = sourceInfo(filename, sourceSize, sourceTime);
+	
+	Mesh* mesh = Memory::allocateLocal<Mesh>(MeshMemory);
+	memset(mesh, 0, sizeof(Mesh));
+	if (readBounds(name, haveSource, sourceSize, sourceTime, mesh)) return mesh;
+	
+	// parses the .obj once and writes the cache, the next start only reads the header
+	Mesh* full = loadMesh(filename);
+	if (full == nullptr) return nullptr;
+	mesh->minx = full->minx;
+	mesh->miny = full->miny;
+	mesh->minz = full->minz;
+	mesh->maxx = full->maxx;
+	mesh->maxy = full->maxy;
+	mesh->maxz = full->maxz;
+	return mesh;
+}
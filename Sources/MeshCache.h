@@ -0,0 +1,13 @@
+#pragma once
+
+#include "ObjLoader.h"
+
+// Loads a mesh through its binary cache (e.g. ball.obj -> ball.obj.kmesh next to it).
+// The cache is memory mapped and used as is, it is regenerated from the .obj
+// whenever the source's size or modification time no longer match.
+Mesh* loadMesh(const char* filename);
+
+// Only the bounds, for a master that collides balls without drawing them. As
+// long as the cache is valid nothing but its header is read, the counts are
+// zero and the vertex data pointers null.
+Mesh* loadMeshBounds(const char* filename);
@@ -0,0 +1,114 @@
+#include "pch.h"
+
+#include "Network.h"
+#include "Recording.h"
+#include "RingBuffer.h"
+
+#include <Kore/Network/Socket.h>
+#include <Kore/System.h>
+#include <Kore/Threads/Thread.h>
+#include <assert.h>
+#include <string.h>
+
+using namespace Kore;
+
+namespace {
+	const int queueSize = 256;
+	
+	Socket socket;
+	Thread* thread = nullptr;
+	std::atomic<bool> running(false);
+	std::atomic<int> dropped(0);
+	
+	RingBuffer<Packet, queueSize> incoming;
+	RingBuffer<Packet, queueSize> outgoing;
+	bool receivedPending = false;
+	
+	Network::SendHandler sendHandler = nullptr;
+	
+	void run(void*) {
+		Packet overflow;
+		while (running.load()) {
+			bool busy = false;
+			
+			while (true) {
+				Packet* packet = incoming.reserve();
+				bool full = packet == nullptr;
+				if (full) packet = &overflow;
+				int read = socket.receive(packet->data, Packet::maxSize, packet->address, packet->port);
+				if (read <= 0) break;
+				busy = true;
+				if (full) {
+					// Still drain the socket so that old datagrams do not pile up in the OS
+					dropped.fetch_add(1);
+					continue;
+				}
+				packet->size = read;
+				packet->time = System::time();
+				incoming.push();
+			}
+			
+			while (Packet* packet = outgoing.front()) {
+				socket.send(packet->address, packet->port, packet->data, packet->size);
+				outgoing.pop();
+				busy = true;
+			}
+			
+			if (!busy) threadSleep(1);
+		}
+	}
+}
+
+void Network::init(int port) {
+	socket.init();
+	socket.open(port);
+	running.store(true);
+	thread = createAndStartThread(run, nullptr);
+}
+
+void Network::shutdown() {
+	running.store(false);
+	if (thread != nullptr) waitForThreadStopThenFree(thread);
+	thread = nullptr;
+}
+
+unsigned Network::resolve(const char* url, int port) {
+	return socket.urlToInt(url, port);
+}
+
+bool Network::send(unsigned address, int port, const u8* data, int size) {
+	assert(size <= Packet::maxSize);
+	Recording::sent(address, port, data, size);
+	if (sendHandler != nullptr) return sendHandler(address, port, data, size);
+	Packet* packet = outgoing.reserve();
+	if (packet == nullptr) {
+		dropped.fetch_add(1);
+		return false;
+	}
+	memcpy(packet->data, data, size);
+	packet->size = size;
+	packet->address = address;
+	packet->port = port;
+	packet->time = System::time();
+	outgoing.push();
+	return true;
+}
+
+const Packet* Network::receive() {
+	if (receivedPending) {
+		incoming.pop();
+		receivedPending = false;
+	}
+	const Packet* packet = incoming.front();
+	receivedPending = packet != nullptr;
+	if (packet != nullptr) Recording::received(*packet);
+	return packet;
+}
+
+int Network::droppedPackets() {
+	return dropped.load();
+}
+
+void Network::setSendHandler(SendHandler handler) {
+	sendHandler = handler;
+}
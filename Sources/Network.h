@@ -0,0 +1,39 @@
+#pragma once
+
+#include <Kore/pch.h>
+
+// Datagrams travel between the socket and the game loop in these
+struct Packet {
+	static const int maxSize = 1400;
+	
+	Kore::u8 data[maxSize];
+	int size;
+	unsigned address;
+	unsigned port;
+	// System::time() when the network thread received or got the packet
+	double time;
+};
+
+// Owns the Socket on a dedicated thread and exchanges packets with the game
+// loop through one lock-free queue per direction, so send and receive always
+// have to be called from the same (game loop) thread.
+namespace Network {
+	void init(int port);
+	void shutdown();
+	
+	unsigned resolve(const char* url, int port);
+	
+	// Queues a datagram, returns false (and drops it) when the queue is full
+	bool send(unsigned address, int port, const Kore::u8* data, int size);
+	
+	// Returns the next received packet, valid until the next call
+	const Packet* receive();
+	
+	// Packets dropped because a queue was full
+	int droppedPackets();
+	
+	// While set, send() hands the datagrams to the function instead of the socket,
+	// for running several endpoints over a simulated link in one process
+	typedef bool (*SendHandler)(unsigned address, int port, const Kore::u8* data, int size);
+	void setSendHandler(SendHandler handler);
+}
@@ -2,253 +2,647 @@
 #include "ObjLoader.h"
 #include "Memory.h"
 #include <Kore/IO/FileReader.h>
+#include <Kore/Math/Core.h>
+#include <Kore/Log.h>
+#include <Kore/System.h>
+#include <Kore/Threads/Thread.h>
 #include <cstring>
 #include <cstdlib>
+#include <math.h>
 #include <assert.h>
 
 using namespace Kore;
 
 namespace {
-	const int maxTokenLength = 256;
-	
-	void tokenize(char* s, char delimiter, int& i, char* token) {
-		int lastIndex = i;
-		char* index = strchr(s + lastIndex + 1, delimiter);
-		if (index == nullptr) {
-			token[0] = 0;
-			return;
+	// Grows in place by doubling, so parsing never needs a counting pass
+	template<class T> struct Array {
+		T* data;
+		int count;
+		int capacity;
+		
+		void init(int initialCapacity) {
+			data = (T*)malloc(initialCapacity * sizeof(T));
+			count = 0;
+			capacity = initialCapacity;
 		}
-		int newIndex = (int)(index - s);
-		i = newIndex;
-		int length = newIndex - lastIndex;
-		assert(length < maxTokenLength);
-		strncpy(token, s + lastIndex + 1, length);
-		token[length] = 0;
-	}
-	
-	int countFirstCharLines(char* source, const char* start) {
-		int count = 0;
 		
-		int index = 0;
-		char line[maxTokenLength];
-		tokenize(source, '\n', index, line);
+		T* push(int n) {
+			if (count + n > capacity) {
+				while (count + n > capacity) capacity *= 2;
+				data = (T*)realloc(data, capacity * sizeof(T));
+				assert(data != nullptr);
+			}
+			T* slot = &data[count];
+			count += n;
+			return slot;
+		}
 		
-		while (line[0] != 0) {
-			char *pch = strstr(line, start);
-			if (pch == line)
-				count++;
-			tokenize(source, '\n', index, line);
+		void free() {
+			::free(data);
+			data = nullptr;
+			count = capacity = 0;
 		}
-		return count;
+	};
+	
+	struct ObjData {
+		Array<float> positions;
+		Array<float> uvs;
+		Array<float> normals;
+		// (position, uv, normal) triple per triangle corner, -1 for a missing attribute
+		Array<int> corners;
+	};
+	
+	const double powersOfTen[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	
+	bool isSpace(char c) {
+		return c == ' ' || c == '\t';
+	}
+	
+	bool isDigit(char c) {
+		return c >= '0' && c <= '9';
 	}
 	
-	int countFacesInLine(char* line) {
-		char* token = strtok(line, " ");
-		int i = -1;
-		while (token != nullptr) {
-			token = strtok(nullptr, " ");
-			i++;
+	void skipSpaces(const char*& p, const char* end) {
+		while (p < end && isSpace(*p)) ++p;
+	}
+	
+	void skipLine(const char*& p, const char* end) {
+		const char* newline = (const char*)memchr(p, '\n', end - p);
+		p = newline != nullptr ? newline + 1 : end;
+	}
+	
+	// Locale independent replacement for strtod, exact for up to 19 significant digits
+	float parseFloat(const char*& p, const char* end) {
+		skipSpaces(p, end);
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = *p == '-';
+			++p;
 		}
 		
-		// For now, handle tris and quads
+		u64 mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+		while (p < end && isDigit(*p)) {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa != 0) ++digits;
+			}
+			else {
+				++exponent;
+			}
+			++p;
+		}
+		if (p < end && *p == '.') {
+			++p;
+			while (p < end && isDigit(*p)) {
+				if (digits < 19) {
+					mantissa = mantissa * 10 + (*p - '0');
+					if (mantissa != 0) ++digits;
+					--exponent;
+				}
+				++p;
+			}
+		}
+		if (p < end && (*p == 'e' || *p == 'E')) {
+			++p;
+			bool negativeExponent = false;
+			if (p < end && (*p == '-' || *p == '+')) {
+				negativeExponent = *p == '-';
+				++p;
+			}
+			int value = 0;
+			while (p < end && isDigit(*p)) {
+				if (value < 10000) value = value * 10 + (*p - '0');
+				++p;
+			}
+			exponent += negativeExponent ? -value : value;
+		}
 		
-		if (i == 3) {
-			return 1;
+		double result = (double)mantissa;
+		while (exponent > 22) {
+			result *= 1e22;
+			exponent -= 22;
 		}
-		else {
-			return 2;
+		while (exponent < -22) {
+			result /= 1e22;
+			exponent += 22;
 		}
+		if (exponent >= 0) result *= powersOfTen[exponent];
+		else result /= powersOfTen[-exponent];
+		
+		return (float)(negative ? -result : result);
 	}
 	
-	int countFaces(char* source) {
-		int count = 0;
-		
-		int index = 0;
-		char line[maxTokenLength];
-		tokenize(source, '\n', index, line);
+	// Relative (negative) indices depend on the counts of all preceding chunks,
+	// they are stored with this bias until the chunks are stitched together
+	const int relativeIndex = 1 << 30;
+	
+	// Parses a one-based (or negative, relative) obj index and returns it zero-based, -1 if absent
+	int parseIndex(const char*& p, const char* end, int count) {
+		bool negative = false;
+		if (p < end && *p == '-') {
+			negative = true;
+			++p;
+		}
+		if (p >= end || !isDigit(*p)) return -1;
+		int value = 0;
+		while (p < end && isDigit(*p)) {
+			value = value * 10 + (*p - '0');
+			++p;
+		}
+		return negative ? relativeIndex + count - value : value - 1;
+	}
+	
+	void parseFloats(Array<float>& array, int count, const char*& p, const char* end) {
+		float* values = array.push(count);
+		for (int i = 0; i < count; ++i) {
+			values[i] = parseFloat(p, end);
+		}
+	}
+	
+	void parseFace(ObjData& obj, const char*& p, const char* end) {
+		const int maxCorners = 64;
+		int verts[maxCorners];
+		int uvIndex[maxCorners];
+		int normalIndex[maxCorners];
 		
-		while (line[0] != 0) {
-			if (line[0] == 'f') {
-				count += countFacesInLine(line);
+		int numVertices = obj.positions.count / 3;
+		int corners = 0;
+		skipSpaces(p, end);
+		while (p < end && *p != '\n' && *p != '\r' && corners < maxCorners) {
+			verts[corners] = parseIndex(p, end, numVertices);
+			uvIndex[corners] = -1;
+			normalIndex[corners] = -1;
+			if (p < end && *p == '/') {
+				++p;
+				uvIndex[corners] = parseIndex(p, end, obj.uvs.count / 2);
+				if (p < end && *p == '/') {
+					++p;
+					normalIndex[corners] = parseIndex(p, end, obj.normals.count / 3);
+				}
 			}
-			tokenize(source, '\n', index, line);
+			// Skip anything unexpected up to the next corner
+			while (p < end && !isSpace(*p) && *p != '\n' && *p != '\r') ++p;
+			++corners;
+			skipSpaces(p, end);
+		}
+		
+		if (corners < 3) return;
+		
+		// Polygons are split into the fan (1, 2, 0), (2, 3, 0), ...
+		for (int i = 2; i < corners; ++i) {
+			int a = i - 1;
+			int b = i;
+			int c = 0;
+			int* triangle = obj.corners.push(9);
+			triangle[0] = verts[a];
+			triangle[1] = uvIndex[a];
+			triangle[2] = normalIndex[a];
+			triangle[3] = verts[b];
+			triangle[4] = uvIndex[b];
+			triangle[5] = normalIndex[b];
+			triangle[6] = verts[c];
+			triangle[7] = uvIndex[c];
+			triangle[8] = normalIndex[c];
 		}
-		return count;
 	}
 	
-	int countVertices(char* source) {
-		return countFirstCharLines(source, "v ");
+	void parse(ObjData& obj, const char* p, const char* end) {
+		while (p < end) {
+			skipSpaces(p, end);
+			if (end - p >= 2 && p[0] == 'v' && isSpace(p[1])) {
+				// Read some vertex data
+				p += 1;
+				parseFloats(obj.positions, 3, p, end);
+			}
+			else if (end - p >= 2 && p[0] == 'f' && isSpace(p[1])) {
+				// Read some face data
+				p += 1;
+				parseFace(obj, p, end);
+			}
+			else if (end - p >= 3 && p[0] == 'v' && p[1] == 't' && isSpace(p[2])) {
+				p += 2;
+				parseFloats(obj.uvs, 2, p, end);
+			}
+			else if (end - p >= 3 && p[0] == 'v' && p[1] == 'n' && isSpace(p[2])) {
+				p += 2;
+				parseFloats(obj.normals, 3, p, end);
+			}
+			
+			// Ignore all other commands (for now)
+			skipLine(p, end);
+		}
 	}
 	
-	int countNormals(char* source) {
-		return countFirstCharLines(source, "vn ");
+	template<class T> T* copyToMemory(const Array<T>& array) {
+		T* data = Memory::allocateLocal<T>(MeshMemory, array.count);
+		memcpy(data, array.data, array.count * sizeof(T));
+		return data;
 	}
 	
-	int countUVs(char* source) {
-		return countFirstCharLines(source, "vt ");
+	unsigned hashCorner(const int* corner) {
+		return (unsigned)corner[0] * 73856093u ^ (unsigned)corner[1] * 19349663u ^ (unsigned)corner[2] * 83492791u;
 	}
 	
-	void parseVertex(Mesh* mesh, char* line) {
-		char* token;
-		for (int i = 0; i < 3; i++) {
-			token = strtok(nullptr, " ");
-			mesh->curVertex[i] = (float)strtod(token, nullptr);
-		}
+	// Merges identical (position, uv, normal) corners into one vertex each.
+	// Returns the triples of the unique vertices and fills indices with one entry per kept corner.
+	void weldCorners(ObjData& obj, Array<int>& vertices, Array<int>& indices) {
+		int numPositions = obj.positions.count / 3;
+		int numUVs = obj.uvs.count / 2;
+		int numNormals = obj.normals.count / 3;
+		int numCorners = obj.corners.count / 3;
 		
-		mesh->curVertex += 3;
-		mesh->curVertex[0] = 0;
-		mesh->curVertex[1] = 0;
-		mesh->curVertex += 5;
+		int tableSize = 1;
+		while (tableSize < numCorners * 2) tableSize *= 2;
+		int* table = (int*)malloc(tableSize * sizeof(int));
+		for (int i = 0; i < tableSize; ++i) table[i] = -1;
 		
-		mesh->numVertices++;
+		for (int triangle = 0; triangle < numCorners; triangle += 3) {
+			int* corners = &obj.corners.data[triangle * 3];
+			bool valid = true;
+			for (int i = 0; i < 3; ++i) {
+				int* corner = &corners[i * 3];
+				if (corner[0] < 0 || corner[0] >= numPositions) valid = false;
+				if (corner[1] < 0 || corner[1] >= numUVs) corner[1] = -1;
+				if (corner[2] < 0 || corner[2] >= numNormals) corner[2] = -1;
+			}
+			if (!valid) continue;
+			
+			int* triangleIndices = indices.push(3);
+			for (int i = 0; i < 3; ++i) {
+				const int* corner = &corners[i * 3];
+				unsigned slot = hashCorner(corner) & (tableSize - 1);
+				while (table[slot] >= 0) {
+					const int* vertex = &vertices.data[table[slot] * 3];
+					if (vertex[0] == corner[0] && vertex[1] == corner[1] && vertex[2] == corner[2]) break;
+					slot = (slot + 1) & (tableSize - 1);
+				}
+				if (table[slot] < 0) {
+					table[slot] = vertices.count / 3;
+					int* vertex = vertices.push(3);
+					vertex[0] = corner[0];
+					vertex[1] = corner[1];
+					vertex[2] = corner[2];
+				}
+				triangleIndices[i] = table[slot];
+			}
+		}
+		
+		free(table);
 	}
 	
-	void setUV(Mesh* mesh, int index, float u, float v) {
-		mesh->vertices[(index * 8) + 3] = u;
-		mesh->vertices[(index * 8) + 4] = v;
+	// Average cache miss ratio (transformed vertices per triangle) for a FIFO post-transform cache
+	float averageCacheMissRatio(const int* indices, int numIndices, int numVertices) {
+		if (numIndices == 0) return 0;
+		const int cacheSize = 16;
+		int* cacheTime = (int*)calloc(numVertices, sizeof(int));
+		int time = cacheSize + 1;
+		int misses = 0;
+		for (int i = 0; i < numIndices; ++i) {
+			int vertex = indices[i];
+			if (time - cacheTime[vertex] > cacheSize) {
+				cacheTime[vertex] = time++;
+				++misses;
+			}
+		}
+		free(cacheTime);
+		return misses / (numIndices / 3.0f);
 	}
 	
-	void setNormal(Mesh* mesh, int index, float x, float y, float z) {
-		mesh->vertices[(index * 8) + 5] = x;
-		mesh->vertices[(index * 8) + 6] = y;
-		mesh->vertices[(index * 8) + 7] = z;
+	// Tom Forsyth's linear-speed vertex cache optimization, scored for a 32 entry LRU cache
+	const int vertexCacheSize = 32;
+	
+	float vertexScore(int cachePosition, int activeTriangles) {
+		if (activeTriangles == 0) return -1.0f;
+		
+		float score = 0;
+		if (cachePosition >= 0) {
+			if (cachePosition < 3) {
+				// The triangle just emitted, deliberately not the best choice to avoid strips
+				score = 0.75f;
+			}
+			else {
+				score = powf(1.0f - (cachePosition - 3) / (float)(vertexCacheSize - 3), 1.5f);
+			}
+		}
+		// Favour vertices with few triangles left so they are finished off
+		return score + 2.0f * powf((float)activeTriangles, -0.5f);
 	}
 	
-	void parseFace(Mesh* mesh, char* line) {
-		char* token;
-		int verts[4];
-		int uvIndex[4];
-		int normalIndex[4];
-		bool hasUV[4];
-		bool hasNormal[4];
-		for (int i = 0; i < 3; i++) {
-			token = strtok(nullptr, " ");
-			char* endPtr;
-			verts[i] = (int)strtol(token, &endPtr, 0) - 1;
-			if (endPtr[0] == '/') {
-				// Parse the uv
-				hasUV[i] = true;
-				uvIndex[i] = (int)strtol(endPtr + 1, &endPtr, 0) - 1;
-			} else {
-				// There is no uv
-				hasUV[i] = false;
-				hasNormal[i] = false;
+	void optimizeVertexCache(int* indices, int numIndices, int numVertices) {
+		int numTriangles = numIndices / 3;
+		if (numTriangles == 0) return;
+		
+		// Triangles of every vertex, the first activeTriangles[v] entries are the not yet emitted ones
+		int* offsets = (int*)calloc(numVertices + 1, sizeof(int));
+		int* activeTriangles = (int*)calloc(numVertices, sizeof(int));
+		for (int i = 0; i < numIndices; ++i) ++activeTriangles[indices[i]];
+		for (int v = 0; v < numVertices; ++v) offsets[v + 1] = offsets[v] + activeTriangles[v];
+		int* triangles = (int*)malloc(numIndices * sizeof(int));
+		int* fill = (int*)calloc(numVertices, sizeof(int));
+		for (int i = 0; i < numIndices; ++i) {
+			int v = indices[i];
+			triangles[offsets[v] + fill[v]++] = i / 3;
+		}
+		free(fill);
+		
+		int* cachePosition = (int*)malloc(numVertices * sizeof(int));
+		float* score = (float*)malloc(numVertices * sizeof(float));
+		for (int v = 0; v < numVertices; ++v) {
+			cachePosition[v] = -1;
+			score[v] = vertexScore(-1, activeTriangles[v]);
+		}
+		
+		float* triangleScore = (float*)malloc(numTriangles * sizeof(float));
+		bool* emitted = (bool*)calloc(numTriangles, sizeof(bool));
+		int bestTriangle = 0;
+		for (int t = 0; t < numTriangles; ++t) {
+			triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+			if (triangleScore[t] > triangleScore[bestTriangle]) bestTriangle = t;
+		}
+		
+		int* output = (int*)malloc(numIndices * sizeof(int));
+		int cache[vertexCacheSize + 3];
+		int cacheCount = 0;
+		int newCache[vertexCacheSize + 3];
+		int cursor = 0;
+		
+		for (int emittedCount = 0; emittedCount < numTriangles; ++emittedCount) {
+			if (bestTriangle < 0) {
+				// Nothing connected to the cache is left, continue with the next untouched triangle
+				while (emitted[cursor]) ++cursor;
+				bestTriangle = cursor;
+			}
+			
+			const int* triangle = &indices[bestTriangle * 3];
+			output[emittedCount * 3 + 0] = triangle[0];
+			output[emittedCount * 3 + 1] = triangle[1];
+			output[emittedCount * 3 + 2] = triangle[2];
+			emitted[bestTriangle] = true;
+			
+			int newCount = 0;
+			for (int i = 0; i < 3; ++i) {
+				int v = triangle[i];
+				int* list = &triangles[offsets[v]];
+				for (int j = 0; j < activeTriangles[v]; ++j) {
+					if (list[j] == bestTriangle) {
+						list[j] = list[activeTriangles[v] - 1];
+						break;
+					}
+				}
+				--activeTriangles[v];
+				newCache[newCount++] = v;
+			}
+			for (int i = 0; i < cacheCount; ++i) {
+				int v = cache[i];
+				if (v != triangle[0] && v != triangle[1] && v != triangle[2]) newCache[newCount++] = v;
 			}
-			if (endPtr[0] == '/') {
-				hasNormal[i] = true;
-				normalIndex[i] = (int)strtol(endPtr + 1, nullptr, 0) - 1;
+			
+			for (int i = 0; i < newCount; ++i) {
+				int v = newCache[i];
+				cachePosition[v] = i < vertexCacheSize ? i : -1;
+				float newScore = vertexScore(cachePosition[v], activeTriangles[v]);
+				float delta = newScore - score[v];
+				score[v] = newScore;
+				for (int j = 0; j < activeTriangles[v]; ++j) {
+					triangleScore[triangles[offsets[v] + j]] += delta;
+				}
+			}
+			
+			cacheCount = newCount < vertexCacheSize ? newCount : vertexCacheSize;
+			memcpy(cache, newCache, cacheCount * sizeof(int));
+			
+			bestTriangle = -1;
+			float bestScore = -1.0f;
+			for (int i = 0; i < cacheCount; ++i) {
+				int v = cache[i];
+				for (int j = 0; j < activeTriangles[v]; ++j) {
+					int t = triangles[offsets[v] + j];
+					if (triangleScore[t] > bestScore) {
+						bestScore = triangleScore[t];
+						bestTriangle = t;
+					}
+				}
 			}
 		}
-		token = strtok(nullptr, " ");
-		//char* result;
-		if (token != nullptr) {
-			verts[3] = (int)strtol(token, nullptr, 0) - 1;
-			// We have a quad
-			mesh->curIndex[0] = verts[0];
-			mesh->curIndex[1] = verts[1];
-			mesh->curIndex[2] = verts[2];
-			mesh->curIndex += 3;
-			mesh->curIndex[0] = verts[2];
-			mesh->curIndex[1] = verts[3];
-			mesh->curIndex[2] = verts[0];
-			mesh->curIndex += 3;
-			mesh->numFaces += 2;
-			mesh->numIndices += 6;
+		
+		memcpy(indices, output, numIndices * sizeof(int));
+		
+		free(output);
+		free(emitted);
+		free(triangleScore);
+		free(score);
+		free(cachePosition);
+		free(triangles);
+		free(activeTriangles);
+		free(offsets);
+	}
+	
+	// Renumbers the vertices in the order the optimized index buffer first uses them
+	void optimizeVertexFetch(int* indices, int numIndices, Array<int>& vertices) {
+		int numVertices = vertices.count / 3;
+		int* remap = (int*)malloc(numVertices * sizeof(int));
+		for (int v = 0; v < numVertices; ++v) remap[v] = -1;
+		int* reordered = (int*)malloc(vertices.count * sizeof(int));
+		int next = 0;
+		for (int i = 0; i < numIndices; ++i) {
+			int v = indices[i];
+			if (remap[v] < 0) {
+				remap[v] = next;
+				memcpy(&reordered[next * 3], &vertices.data[v * 3], 3 * sizeof(int));
+				++next;
+			}
+			indices[i] = remap[v];
 		}
-		else {
-			// We have a triangle
-			for (int i = 0; i < 3; i++) {
-				mesh->curIndex[i] = verts[i];
-				
-				if (!hasUV[i]) continue;
-				
-				// Set the UVs
-				setUV(mesh, mesh->curIndex[i], mesh->uvs[uvIndex[i] * 2], mesh->uvs[(uvIndex[i] * 2) + 1]);
-				
-				if (!hasNormal[i]) continue;
-				
-				// Set the Normal
-				setNormal(mesh, mesh->curIndex[i], mesh->normals[normalIndex[i] * 3], mesh->normals[normalIndex[i] * 3 + 1], mesh->normals[normalIndex[i] * 3 + 2]);
+		memcpy(vertices.data, reordered, next * 3 * sizeof(int));
+		vertices.count = next * 3;
+		free(reordered);
+		free(remap);
+	}
+	
+	Mesh* createMesh(const char* filename, ObjData& obj) {
+		Array<int> vertices;
+		Array<int> indices;
+		vertices.init(1024 * 3);
+		indices.init(2048 * 3);
+		weldCorners(obj, vertices, indices);
+		
+		float acmrBefore = averageCacheMissRatio(indices.data, indices.count, vertices.count / 3);
+		optimizeVertexCache(indices.data, indices.count, vertices.count / 3);
+		optimizeVertexFetch(indices.data, indices.count, vertices);
+		float acmrAfter = averageCacheMissRatio(indices.data, indices.count, vertices.count / 3);
+		
+		Mesh* mesh = Memory::allocateLocal<Mesh>(MeshMemory);
+		mesh->numVertices = vertices.count / 3;
+		mesh->numUVs = obj.uvs.count / 2;
+		mesh->numNormals = obj.normals.count / 3;
+		mesh->numIndices = indices.count;
+		mesh->numFaces = indices.count / 3;
+		
+		mesh->minx = mesh->miny = mesh->minz = 9999999;
+		mesh->maxx = mesh->maxy = mesh->maxz = -9999999;
+		mesh->vertices = Memory::allocateLocal<float>(MeshMemory, mesh->numVertices * 8);
+		for (int i = 0; i < mesh->numVertices; ++i) {
+			const int* source = &vertices.data[i * 3];
+			const float* position = &obj.positions.data[source[0] * 3];
+			float* vertex = &mesh->vertices[i * 8];
+			vertex[0] = position[0];
+			vertex[1] = position[1];
+			vertex[2] = position[2];
+			mesh->minx = min(position[0], mesh->minx);
+			mesh->maxx = max(position[0], mesh->maxx);
+			mesh->miny = min(position[1], mesh->miny);
+			mesh->maxy = max(position[1], mesh->maxy);
+			mesh->minz = min(position[2], mesh->minz);
+			mesh->maxz = max(position[2], mesh->maxz);
+		
+			if (source[1] >= 0) {
+				vertex[3] = obj.uvs.data[source[1] * 2 + 0];
+				vertex[4] = 1.0f - obj.uvs.data[source[1] * 2 + 1];
+			}
+			else {
+				vertex[3] = 0;
+				vertex[4] = 1.0f;
 			}
-			mesh->curIndex += 3;
-			mesh->numFaces += 1;
-			mesh->numIndices += 3;
+			
+			if (source[2] >= 0) {
+				vertex[5] = obj.normals.data[source[2] * 3 + 0];
+				vertex[6] = obj.normals.data[source[2] * 3 + 1];
+				vertex[7] = obj.normals.data[source[2] * 3 + 2];
+			}
+			else {
+				vertex[5] = vertex[6] = vertex[7] = 0;
+			}
+		}
+		
+		mesh->indices = copyToMemory(indices);
+		mesh->uvs = copyToMemory(obj.uvs);
+		mesh->normals = copyToMemory(obj.normals);
+		
+		log(Info, "Loaded %s: %i vertices from %i positions, ACMR %.3f -> %.3f", filename, mesh->numVertices, obj.positions.count / 3, acmrBefore, acmrAfter);
+		
+		vertices.free();
+		indices.free();
+		return mesh;
+	}
+	
+	const int maxParseThreads = 8;
+	const int bytesPerParseThread = 1024 * 1024;
+	
+	struct Chunk {
+		const char* begin;
+		const char* end;
+		ObjData obj;
+		Thread* thread;
+	};
+	
+	void parseChunk(void* param) {
+		Chunk* chunk = (Chunk*)param;
+		ObjData& obj = chunk->obj;
+		int size = (int)(chunk->end - chunk->begin);
+		// Rough guess from the size of a typical line to avoid most regrowing
+		obj.positions.init(size / 32 + 16);
+		obj.uvs.init(size / 64 + 16);
+		obj.normals.init(size / 32 + 16);
+		obj.corners.init(size / 4 + 16);
+		parse(obj, chunk->begin, chunk->end);
+	}
+	
+	void resolveIndices(int* corners, int count, int positionBase, int uvBase, int normalBase) {
+		const int bases[3] = { positionBase, uvBase, normalBase };
+		for (int i = 0; i < count; ++i) {
+			if (corners[i] >= relativeIndex / 2) corners[i] = corners[i] - relativeIndex + bases[i % 3];
 		}
 	}
 	
-	void parseUV(Mesh* mesh, char* line) {
-		char* token;
-		for (int i = 0; i < 2; i++) {
-			token = strtok(nullptr, " ");
-			*mesh->curUV = (float)strtod(token, nullptr);
-			mesh->curUV++;
+	template<class T> void append(Array<T>& target, const Array<T>& source) {
+		if (source.count > 0) memcpy(target.push(source.count), source.data, source.count * sizeof(T));
+	}
+	
+	// Concatenates the chunks in file order into the first one, a running prefix sum of
+	// the element counts gives every chunk the global base of its relative indices
+	void stitchChunks(Chunk* chunks, int count) {
+		ObjData& obj = chunks[0].obj;
+		resolveIndices(obj.corners.data, obj.corners.count, 0, 0, 0);
+		for (int i = 1; i < count; ++i) {
+			ObjData& chunk = chunks[i].obj;
+			int positionBase = obj.positions.count / 3;
+			int uvBase = obj.uvs.count / 2;
+			int normalBase = obj.normals.count / 3;
+			int cornerBase = obj.corners.count;
+			
+			append(obj.positions, chunk.positions);
+			append(obj.uvs, chunk.uvs);
+			append(obj.normals, chunk.normals);
+			append(obj.corners, chunk.corners);
+			resolveIndices(&obj.corners.data[cornerBase], chunk.corners.count, positionBase, uvBase, normalBase);
+			
+			chunk.positions.free();
+			chunk.uvs.free();
+			chunk.normals.free();
+			chunk.corners.free();
 		}
 	}
-	
-	void parseNormal(Mesh* mesh, char* line) {
-		char* token;
-		for (int i = 0; i < 3; i++) {
-			token = strtok(nullptr, " ");
-			*mesh->curNormal = (float)strtod(token, nullptr);
-			mesh->curNormal++;
-		}
-	}
-	
-	void parseLine(Mesh* mesh, char* line) {
-		char* token = strtok(line, " ");
-		if (strcmp(token, "v") == 0) {
-			// Read some vertex data
-			parseVertex(mesh, line);
-		}
-		else if (strcmp(token, "f") == 0) {
-			// Read some face data
-			parseFace(mesh, line);
-		}
-		else if (strcmp(token, "vt") == 0) {
-			parseUV(mesh, line);
-		} else if (strcmp(token, "vn") == 0) {
-			parseNormal(mesh, line);
-		}
-		
-		// Ignore all other commands (for now)
-	}
 }
 
-Mesh* loadObj(const char* filename) {
-	FileReader fileReader(filename, FileReader::Asset);
-	void* data = fileReader.readAll();
-	int length = fileReader.size() + 1;
-	char* source = Memory::scratchPad<char>(length);
-	memcpy(source, data, length);
-	source[length] = 0;
-	
-	Mesh* mesh = Memory::allocate<Mesh>();
-	mesh->numIndices = 0;
-	int vertices = countVertices(source);
-	mesh->vertices = Memory::allocate<float>(vertices * 8);
-	mesh->curVertex = mesh->vertices;
-	int faces = countFaces(source);
-	mesh->indices = Memory::allocate<int>(faces * 3);
-	mesh->curIndex = mesh->indices;
-	mesh->numUVs = countUVs(source);
-	mesh->uvs = Memory::allocate<float>(mesh->numUVs * 2);
-	mesh->curUV = mesh->uvs;
-	int normals = countNormals(source);
-	mesh->numNormals = normals;
-	mesh->normals = Memory::allocate<float>(normals * 3);
-	mesh->curNormal = mesh->normals;
-	
-	mesh->numVertices = 0;
-	mesh->numFaces = 0;
-	
-	int index = 0;
-	char line[maxTokenLength];
-	tokenize(source, '\n', index, line);
-	
-	while (line[0] != 0) {
-		parseLine(mesh, line);
-		tokenize(source, '\n', index, line);
+Mesh* parseObj(const char* name, const char* source, int length, int threadCount, ObjLoadTimes* times) {
+	double startTime = System::time();
+	
+	if (threadCount <= 0) {
+		threadCount = length / bytesPerParseThread;
 	}
+	if (threadCount > maxParseThreads) threadCount = maxParseThreads;
+	if (threadCount < 1) threadCount = 1;
 	
+	// Split into line aligned chunks, the first one is parsed on the calling thread
+	Chunk chunks[maxParseThreads];
+	const char* end = source + length;
+	const char* begin = source;
+	for (int i = 0; i < threadCount; ++i) {
+		const char* chunkEnd = end;
+		if (i < threadCount - 1) {
+			chunkEnd = source + (size_t)length * (i + 1) / threadCount;
+			if (chunkEnd < begin) chunkEnd = begin;
+			skipLine(chunkEnd, end);
+		}
+		chunks[i].begin = begin;
+		chunks[i].end = chunkEnd;
+		chunks[i].thread = nullptr;
+		begin = chunkEnd;
+	}
+	
+	for (int i = 1; i < threadCount; ++i) {
+		chunks[i].thread = createAndStartThread(parseChunk, &chunks[i]);
+	}
+	parseChunk(&chunks[0]);
+	for (int i = 1; i < threadCount; ++i) {
+		waitForThreadStopThenFree(chunks[i].thread);
+	}
+	stitchChunks(chunks, threadCount);
+	
+	double parseTime = System::time();
+	
+	ObjData& obj = chunks[0].obj;
+	Mesh* mesh = createMesh(name, obj);
+	
+	obj.positions.free();
+	obj.uvs.free();
+	obj.normals.free();
+	obj.corners.free();
+	
+	if (times != nullptr) {
+		times->parse = parseTime - startTime;
+		times->build = System::time() - parseTime;
+	}
 	return mesh;
 }
+
+Mesh* loadObj(const char* filename, int threadCount) {
+	FileReader fileReader(filename, FileReader::Asset);
+	const char* source = (const char*)fileReader.readAll();
+	return parseObj(filename, source, fileReader.size(), threadCount);
+}
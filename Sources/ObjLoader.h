@@ -7,16 +7,22 @@ struct Mesh {
 	int numNormals;
 	int numIndices;
 	
+	// Interleaved pos/uv/normal, 8 floats per vertex, v already flipped for Kore's textures
 	float* vertices;
 	int* indices;
 	float* uvs;
-	float * normals;
+	float* normals;
 	
-	// very private
-	float* curVertex;
-	int* curIndex;
-	float* curUV;
-	float* curNormal;
+	float minx, miny, minz;
+	float maxx, maxy, maxz;
 };
 
-Mesh* loadObj(const char* filename);
+struct ObjLoadTimes {
+	double parse; // Reading the text, in seconds
+	double build; // Welding and optimizing the mesh
+};
+
+// Files are split into line aligned chunks which are parsed on threadCount threads,
+// 0 picks one thread per MB of text (at most 8).
+Mesh* loadObj(const char* filename, int threadCount = 0);
+Mesh* parseObj(const char* name, const char* source, int length, int threadCount = 0, ObjLoadTimes* times = nullptr);
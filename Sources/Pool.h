@@ -0,0 +1,47 @@
+#pragma once
+
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <assert.h>
+
+// Storage for up to capacity objects with a free list through the unused
+// slots. create() and destroy() never touch the heap, so objects that come
+// and go every frame cost no allocations. Objects still alive when the pool
+// goes away are not destroyed. Not thread safe.
+template<class T, int capacity> class Pool {
+public:
+	Pool() : firstFree(0), count(0) {
+		for (int i = 0; i < capacity; ++i) next[i] = i + 1;
+	}
+	
+	// Returns nullptr when all slots are taken
+	template<class... Args> T* create(Args&&... args) {
+		if (firstFree == capacity) return nullptr;
+		int index = firstFree;
+		firstFree = next[index];
+		++count;
+		return new (&slots[index]) T(std::forward<Args>(args)...);
+	}
+	
+	void destroy(T* object) {
+		int index = (int)((Slot*)object - slots);
+		assert(index >= 0 && index < capacity);
+		object->~T();
+		next[index] = firstFree;
+		firstFree = index;
+		--count;
+	}
+	
+	int size() const {
+		return count;
+	}
+
+private:
+	typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Slot;
+	
+	Slot slots[capacity];
+	int next[capacity];
+	int firstFree;
+	int count;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+// A master drops slaves it did not hear from for this long, a slave that
+// heard nothing for longer says hello again
+const double clientTimeout = 5.0;
+
+// First byte of every message
+enum MessageType {
+	// slave -> master, the first reliable message: session (u32), a new one on every connect
+	Hello,
+	// master -> slave, reliable: ball id (u16) and quantized state (4 x u32)
+	Welcome,
+	// master -> slave
+	StateSnapshot,
+	// slave -> master
+	PlayerInputs
+};
+
+// Counters since the last takeStats() of a Master or Slave
+struct NetworkStats {
+	int snapshots;
+	int snapshotBytes;
+	// the same snapshots as one float per position and rotation component
+	int rawSnapshotBytes;
+	int corrections;
+	int replayedTicks;
+	int lateSnapshots;
+	int resentMessages;
+	double roundTripTime;
+	double packetLoss;
+	// Snapshots per second, averaged over the clients on the master
+	double sendRate;
+};
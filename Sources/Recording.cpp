@@ -0,0 +1,163 @@
+#include "pch.h"
+
+#include "Recording.h"
+
+#include <Kore/Log.h>
+#include <stdio.h>
+#include <string.h>
+
+using namespace Kore;
+
+namespace {
+	const char magic[4] = { 'K', 'R', 'E', 'C' };
+	const u32 version = 1;
+	
+	// Written in the byte order of the machine, replays run on the same kind of machine
+	struct FileHeader {
+		char magic[4];
+		u32 version;
+		double startTime;
+	};
+	
+	// Followed by size bytes of data for datagrams
+	struct DatagramHeader {
+		double time;
+		u32 address;
+		u16 port;
+		u16 size;
+	};
+	
+	struct KeyEvent {
+		s32 key;
+		u8 down;
+	};
+	
+	// A crashed or killed session loses at most this much of its end
+	const double flushInterval = 1.0;
+	
+	FILE* file = nullptr;
+	double lastFlush;
+	
+	void write(u8 type, const void* data, size_t size) {
+		fwrite(&type, 1, 1, file);
+		fwrite(data, size, 1, file);
+	}
+	
+	void writeDatagram(u8 type, double time, unsigned address, int port, const u8* data, int size) {
+		DatagramHeader header;
+		header.time = time;
+		header.address = address;
+		header.port = (u16)port;
+		header.size = (u16)size;
+		write(type, &header, sizeof(header));
+		fwrite(data, size, 1, file);
+	}
+}
+
+bool Recording::start(const char* filename, double startTime) {
+	stop();
+	file = fopen(filename, "wb");
+	if (file == nullptr) {
+		log(Warning, "Could not create recording %s", filename);
+		return false;
+	}
+	setvbuf(file, nullptr, _IOFBF, 64 * 1024);
+	FileHeader header;
+	memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	header.startTime = startTime;
+	fwrite(&header, sizeof(header), 1, file);
+	lastFlush = startTime;
+	return true;
+}
+
+void Recording::stop() {
+	if (file == nullptr) return;
+	fclose(file);
+	file = nullptr;
+}
+
+bool Recording::active() {
+	return file != nullptr;
+}
+
+void Recording::frame(double time) {
+	if (file == nullptr) return;
+	write(FrameRecord, &time, sizeof(time));
+	if (time - lastFlush > flushInterval) {
+		fflush(file);
+		lastFlush = time;
+	}
+}
+
+void Recording::received(const Packet& packet) {
+	if (file == nullptr) return;
+	writeDatagram(ReceivedRecord, packet.time, packet.address, packet.port, packet.data, packet.size);
+}
+
+void Recording::sent(unsigned address, int port, const u8* data, int size) {
+	if (file == nullptr) return;
+	writeDatagram(SentRecord, 0, address, port, data, size);
+}
+
+void Recording::key(int key, bool down) {
+	if (file == nullptr) return;
+	KeyEvent event;
+	memset(&event, 0, sizeof(event));
+	event.key = key;
+	event.down = down ? 1 : 0;
+	write(KeyRecord, &event, sizeof(event));
+}
+
+RecordingReader::RecordingReader() : file(nullptr), start(0) {}
+
+RecordingReader::~RecordingReader() {
+	if (file != nullptr) fclose(file);
+}
+
+bool RecordingReader::open(const char* filename) {
+	file = fopen(filename, "rb");
+	if (file == nullptr) return false;
+	FileHeader header;
+	if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version) {
+		fclose(file);
+		file = nullptr;
+		return false;
+	}
+	start = header.startTime;
+	return true;
+}
+
+double RecordingReader::startTime() const {
+	return start;
+}
+
+bool RecordingReader::next(RecordedEvent& event) {
+	u8 type;
+	if (file == nullptr || fread(&type, 1, 1, file) != 1) return false;
+	event.type = (RecordType)type;
+	switch (type) {
+	case FrameRecord:
+		return fread(&event.time, sizeof(event.time), 1, file) == 1;
+	case ReceivedRecord:
+	case SentRecord: {
+		DatagramHeader header;
+		if (fread(&header, sizeof(header), 1, file) != 1 || header.size > Packet::maxSize) return false;
+		event.time = header.time;
+		event.packet.time = header.time;
+		event.packet.address = header.address;
+		event.packet.port = header.port;
+		event.packet.size = header.size;
+		return fread(event.packet.data, 1, header.size, file) == header.size;
+	}
+	case KeyRecord: {
+		KeyEvent key;
+		if (fread(&key, sizeof(key), 1, file) != 1) return false;
+		event.key = key.key;
+		event.down = key.down != 0;
+		return true;
+	}
+	default:
+		return false;
+	}
+}
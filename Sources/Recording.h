@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Network.h"
+
+#include <stdio.h>
+
+enum RecordType {
+	// Start of an update(), with its time
+	FrameRecord,
+	// A packet the game loop got from Network::receive()
+	ReceivedRecord,
+	// A datagram handed to Network::send()
+	SentRecord,
+	// A key callback, between two frames
+	KeyRecord
+};
+
+struct RecordedEvent {
+	RecordType type;
+	double time;
+	int key;
+	bool down;
+	// Received and sent datagrams, the address and port are the sender or the destination
+	Packet packet;
+};
+
+// Writes everything from outside that the game loop depends on into a binary
+// log, in the order it happened. Times are stored as they were, so a replay
+// runs into exactly the same branches as the recorded session.
+namespace Recording {
+	// Returns false when the file can not be created
+	bool start(const char* filename, double startTime);
+	void stop();
+	bool active();
+	
+	void frame(double time);
+	void received(const Packet& packet);
+	void sent(unsigned address, int port, const Kore::u8* data, int size);
+	void key(int key, bool down);
+}
+
+// Reads a recording back event by event
+class RecordingReader {
+public:
+	RecordingReader();
+	~RecordingReader();
+	
+	// Returns false when the file is missing or not a recording
+	bool open(const char* filename);
+	double startTime() const;
+	
+	// False at the end of the recording or at a truncated event
+	bool next(RecordedEvent& event);
+
+private:
+	FILE* file;
+	double start;
+};
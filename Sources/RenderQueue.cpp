@@ -0,0 +1,162 @@
+#include "pch.h"
+
+// The headless master draws nothing
+#ifndef HEADLESS
+
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+#include "Memory.h"
+
+using namespace Kore;
+
+namespace {
+	const int initialCapacity = 16;
+	
+	struct ByKey {
+		const u64* keys;
+		
+		bool operator()(int a, int b) const {
+			return keys[a] < keys[b];
+		}
+	};
+}
+
+RenderQueue::RenderQueue(const Graphics4::VertexStructure& instanceStructure) : structure(instanceStructure), pipelineCount(0), currentPipeline(-1), itemCount(0), frameInstances(nullptr), instanceCount(0), lastDrawCalls(0), lastStateChanges(0) {}
+
+RenderQueue::~RenderQueue() {
+	for (int i = 0; i < itemCount; ++i) delete items[i].buffer;
+}
+
+void RenderQueue::setPipeline(Graphics4::PipelineState* pipeline, Graphics4::TextureUnit tex, Graphics4::ConstantLocation pvLocation) {
+	for (int i = 0; i < pipelineCount; ++i) {
+		if (pipelines[i].state == pipeline) {
+			currentPipeline = i;
+			return;
+		}
+	}
+	assert(pipelineCount < maxPipelines);
+	Pipeline& added = pipelines[pipelineCount];
+	added.state = pipeline;
+	added.tex = tex;
+	added.pvLocation = pvLocation;
+	currentPipeline = pipelineCount++;
+}
+
+void RenderQueue::begin() {
+	frameInstances = Memory::allocateFrame<Instance>(maxInstances);
+	instanceCount = 0;
+}
+
+// A handful of items, a linear search is the fastest
+int RenderQueue::find(MeshAsset* mesh, TextureAsset* texture) {
+	u64 key = (u64)currentPipeline << 40 | (u64)texture->id << 20 | (u64)mesh->id;
+	for (int i = 0; i < itemCount; ++i) {
+		if (items[i].key == key) return i;
+	}
+	assert(itemCount < maxItems);
+	Item& item = items[itemCount];
+	item.key = key;
+	item.pipeline = currentPipeline;
+	item.mesh = mesh;
+	item.texture = texture;
+	item.buffer = nullptr;
+	item.capacity = 0;
+	item.count = 0;
+	return itemCount++;
+}
+
+void RenderQueue::add(MeshAsset* mesh, TextureAsset* texture, const mat4* M) {
+	assert(frameInstances != nullptr && currentPipeline >= 0);
+	// beyond that objects are not drawn
+	if (instanceCount == maxInstances) return;
+	Instance& instance = frameInstances[instanceCount++];
+	instance.item = find(mesh, texture);
+	instance.M = M;
+	++items[instance.item].count;
+}
+
+void RenderQueue::draw(const mat4& PV) {
+	// grow the buffers before anything is locked
+	float* data[maxItems];
+	int order[maxItems];
+	u64 keys[maxItems];
+	int orderCount = 0;
+	for (int i = 0; i < itemCount; ++i) {
+		Item& item = items[i];
+		keys[i] = item.key;
+		if (item.count == 0) continue;
+		if (item.count > item.capacity) {
+			delete item.buffer;
+			item.capacity = item.capacity == 0 ? initialCapacity : item.capacity;
+			while (item.capacity < item.count) item.capacity *= 2;
+			item.buffer = new Graphics4::VertexBuffer(item.capacity, structure, 1);
+		}
+		data[i] = item.buffer->lock(0, item.count);
+		order[orderCount++] = i;
+	}
+	
+	// one pass over the objects, each matrix goes to the end of its item
+	for (int i = 0; i < instanceCount; ++i) {
+		const Instance& instance = frameInstances[i];
+		memcpy(data[instance.item], &instance.M->matrix[0][0], 16 * sizeof(float));
+		data[instance.item] += 16;
+	}
+	
+	ByKey byKey;
+	byKey.keys = keys;
+	std::sort(order, order + orderCount, byKey);
+	
+	// nothing is known to be bound at the start of a frame
+	int boundPipeline = -1;
+	TextureAsset* boundTexture = nullptr;
+	MeshAsset* boundMesh = nullptr;
+	lastDrawCalls = 0;
+	lastStateChanges = 0;
+	for (int i = 0; i < orderCount; ++i) {
+		Item& item = items[order[i]];
+		item.buffer->unlock();
+		const Pipeline& pipeline = pipelines[item.pipeline];
+		if (item.pipeline != boundPipeline) {
+			Graphics4::setPipeline(pipeline.state);
+			Graphics4::setMatrix(pipeline.pvLocation, PV);
+			boundPipeline = item.pipeline;
+			boundTexture = nullptr;
+			++lastStateChanges;
+		}
+		if (item.texture != boundTexture) {
+			Graphics4::setTexture(pipeline.tex, item.texture->texture);
+			boundTexture = item.texture;
+			++lastStateChanges;
+		}
+		// the instance stream is different for every item
+		Graphics4::VertexBuffer* buffers[2] = { item.mesh->vertexBuffer, item.buffer };
+		Graphics4::setVertexBuffers(buffers, 2);
+		++lastStateChanges;
+		if (item.mesh != boundMesh) {
+			Graphics4::setIndexBuffer(*item.mesh->indexBuffer);
+			boundMesh = item.mesh;
+			++lastStateChanges;
+		}
+		Graphics4::drawIndexedVerticesInstanced(item.count);
+		item.count = 0;
+		++lastDrawCalls;
+	}
+	frameInstances = nullptr;
+}
+
+int RenderQueue::drawCalls() const {
+	return lastDrawCalls;
+}
+
+int RenderQueue::instances() const {
+	return instanceCount;
+}
+
+int RenderQueue::stateChanges() const {
+	return lastStateChanges;
+}
+
+#endif // HEADLESS
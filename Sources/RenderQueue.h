@@ -0,0 +1,74 @@
+#pragma once
+
+#include <Kore/Graphics4/Graphics.h>
+#include <Kore/Graphics4/PipelineState.h>
+#include <Kore/Math/Matrix.h>
+#include "Assets.h"
+
+// Collects the objects of a frame into draw items, one for every pipeline,
+// texture and mesh, and draws each item with one instanced draw call. The
+// model matrices go into a second vertex stream, every item keeps its own
+// instance buffer and grows it when more objects show up than it can take.
+// The items are sorted by a key of pipeline, texture and mesh, and only the
+// state that differs from the previous item is bound.
+class RenderQueue {
+public:
+	// The structure of the instance stream, a single Float4x4 element
+	RenderQueue(const Kore::Graphics4::VertexStructure& instanceStructure);
+	~RenderQueue();
+	
+	// Objects added after this use the pipeline, PV is set whenever it is bound
+	void setPipeline(Kore::Graphics4::PipelineState* pipeline, Kore::Graphics4::TextureUnit tex, Kore::Graphics4::ConstantLocation pvLocation);
+	
+	// Call once per frame before adding the objects, takes frame memory
+	void begin();
+	// The matrix is read in draw()
+	void add(MeshAsset* mesh, TextureAsset* texture, const Kore::mat4* M);
+	void draw(const Kore::mat4& PV);
+	
+	// Of the last draw()
+	int drawCalls() const;
+	int instances() const;
+	// Pipeline, texture, vertex buffer and index buffer binds
+	int stateChanges() const;
+
+private:
+	static const int maxPipelines = 8;
+	static const int maxItems = 32;
+	static const int maxInstances = 4096;
+	
+	struct Pipeline {
+		Kore::Graphics4::PipelineState* state;
+		Kore::Graphics4::TextureUnit tex;
+		Kore::Graphics4::ConstantLocation pvLocation;
+	};
+	
+	struct Item {
+		// Pipeline, texture id and mesh id from the most to the least significant bits
+		Kore::u64 key;
+		int pipeline;
+		MeshAsset* mesh;
+		TextureAsset* texture;
+		Kore::Graphics4::VertexBuffer* buffer;
+		int capacity;
+		int count;
+	};
+	
+	struct Instance {
+		int item;
+		const Kore::mat4* M;
+	};
+	
+	int find(MeshAsset* mesh, TextureAsset* texture);
+	
+	const Kore::Graphics4::VertexStructure& structure;
+	Pipeline pipelines[maxPipelines];
+	int pipelineCount;
+	int currentPipeline;
+	Item items[maxItems];
+	int itemCount;
+	Instance* frameInstances;
+	int instanceCount;
+	int lastDrawCalls;
+	int lastStateChanges;
+};
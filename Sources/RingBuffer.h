@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+
+// Lock-free queue for exactly one producer thread and one consumer thread.
+// Size has to be a power of two, one slot is kept free to tell full from empty.
+template<class T, int size> class RingBuffer {
+public:
+	RingBuffer() : head(0), tail(0) {
+		static_assert((size & (size - 1)) == 0, "RingBuffer size has to be a power of two");
+	}
+	
+	// Producer: returns the slot to fill or nullptr when full, commit with push()
+	T* reserve() {
+		int index = head.load(std::memory_order_relaxed);
+		if (((index + 1) & (size - 1)) == tail.load(std::memory_order_acquire)) return nullptr;
+		return &items[index];
+	}
+	
+	void push() {
+		int index = head.load(std::memory_order_relaxed);
+		head.store((index + 1) & (size - 1), std::memory_order_release);
+	}
+	
+	// Consumer: returns the oldest item or nullptr when empty, release it with pop()
+	T* front() {
+		int index = tail.load(std::memory_order_relaxed);
+		if (index == head.load(std::memory_order_acquire)) return nullptr;
+		return &items[index];
+	}
+	
+	void pop() {
+		int index = tail.load(std::memory_order_relaxed);
+		tail.store((index + 1) & (size - 1), std::memory_order_release);
+	}
+
+private:
+	T items[size];
+	std::atomic<int> head;
+	std::atomic<int> tail;
+};
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <Kore/pch.h>
+
+// Comparison of 16 bit sequence numbers that keeps working when they wrap around
+inline bool sequenceGreater(Kore::u16 a, Kore::u16 b) {
+	return (a > b && a - b <= 32768) || (a < b && b - a > 32768);
+}
@@ -0,0 +1,158 @@
+#include "pch.h"
+
+#include "Simulation.h"
+
+#include <string.h>
+
+using namespace Kore;
+
+namespace {
+	const float playerSpeed = 0.05f;
+	const float npcSpeed = 0.04f;
+	
+	// sin and cos of half the rotation per tick (3 radians per unit moved),
+	// written out so that no libm implementation decides the result
+	struct Turn {
+		float halfSin, halfCos;
+	};
+	const Turn playerTurn = { 0.0749297068f, 0.997188807f };
+	const Turn npcTurn = { 0.0599640049f, 0.998200536f };
+	
+	// One tick's rotation around the axis, backwards for negative directions
+	Quaternion turn(float x, float y, float z, float direction, const Turn& step) {
+		float s = direction < 0 ? -step.halfSin : step.halfSin;
+		return Quaternion(x * s, y * s, z * s, step.halfCos);
+	}
+	
+	void move(EntityState& ball, float dx, float dy, const Turn& step) {
+		ball.x += dx;
+		if (ball.x > 1) {
+			ball.x = 1;
+		}
+		if (ball.x < -1) {
+			ball.x = -1;
+		}
+		ball.y += dy;
+		if (ball.y < -4) {
+			ball.y = 4;
+		}
+		if (ball.y > 4) {
+			ball.y = -4;
+		}
+		if (dy != 0) ball.rotation = ball.rotation.rotated(turn(-1, 0, 0, dy, step));
+		if (dx != 0) ball.rotation = ball.rotation.rotated(turn(0, 1, 0, dx, step));
+	}
+	
+	u32 hash(u32 value, float f) {
+		u32 bits;
+		memcpy(&bits, &f, sizeof(bits));
+		for (int i = 0; i < 4; ++i) {
+			value ^= (bits >> (i * 8)) & 0xff;
+			value *= 16777619u;
+		}
+		return value;
+	}
+}
+
+Simulation::Simulation(u32 seed) : tickCount(0), randomState(seed != 0 ? seed : 1) {
+	for (int i = 0; i < maxBalls; ++i) active[i] = false;
+	
+	EntityState npc;
+	npc.x = random() * 2 - 1;
+	npc.y = 4.0f;
+	npc.z = 0;
+	npc.rotation = Quaternion(0, 0, 0, 1);
+	place(npcBall, npc);
+}
+
+int Simulation::spawnPlayer() {
+	for (int i = 0; i < maxBalls; ++i) {
+		if (active[i]) continue;
+		EntityState state;
+		state.x = random() * 2 - 1;
+		state.y = -2.0f;
+		state.z = 0;
+		state.rotation = Quaternion(0, 0, 0, 1);
+		place(i, state);
+		return i;
+	}
+	return -1;
+}
+
+void Simulation::place(int ball, const EntityState& state) {
+	active[ball] = true;
+	balls[ball] = previous[ball] = state;
+}
+
+void Simulation::remove(int ball) {
+	active[ball] = false;
+}
+
+bool Simulation::isActive(int ball) const {
+	return active[ball];
+}
+
+// xorshift32, the top 24 bits give every float in [0, 1) the same chance
+float Simulation::random() {
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 17;
+	randomState ^= randomState << 5;
+	return (randomState >> 8) * (1.0f / 16777216.0f);
+}
+
+void Simulation::beginTick() {
+	for (int i = 0; i < maxBalls; ++i) {
+		if (active[i]) previous[i] = balls[i];
+	}
+}
+
+void Simulation::movePlayer(int ball, const PlayerInput& input) {
+	float dx = input.left ? -playerSpeed : input.right ? playerSpeed : 0;
+	float dy = input.up ? playerSpeed : input.down ? -playerSpeed : 0;
+	move(balls[ball], dx, dy, playerTurn);
+}
+
+void Simulation::endTick() {
+	EntityState& npc = balls[npcBall];
+	move(npc, 0, -npcSpeed, npcTurn);
+	if (npc.y == 4) {
+		npc.x = random() * 2 - 1;
+	}
+	
+	++tickCount;
+}
+
+void Simulation::respawnNpc() {
+	EntityState& npc = balls[npcBall];
+	npc.x = random() * 2 - 1;
+	npc.y = 4.0f;
+	// no interpolation through the playfield
+	previous[npcBall] = npc;
+}
+
+EntityState Simulation::renderState(int ball, float alpha) const {
+	return interpolate(previous[ball], balls[ball], alpha);
+}
+
+u32 Simulation::currentTick() const {
+	return tickCount;
+}
+
+u32 Simulation::checksum() const {
+	u32 value = 2166136261u;
+	for (int i = 0; i < maxBalls; ++i) {
+		if (!active[i]) continue;
+		const EntityState& ball = balls[i];
+		value = hash(value, (float)i);
+		value = hash(value, ball.x);
+		value = hash(value, ball.y);
+		value = hash(value, ball.z);
+		value = hash(value, ball.rotation.x);
+		value = hash(value, ball.rotation.y);
+		value = hash(value, ball.rotation.z);
+		value = hash(value, ball.rotation.w);
+	}
+	value ^= randomState;
+	value *= 16777619u;
+	return value;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Snapshot.h"
+
+const int tickRate = 60;
+const double tickTime = 1.0 / tickRate;
+
+struct PlayerInput {
+	bool left, right, up, down;
+};
+
+// Game state advanced in fixed ticks. The result only depends on the seed and
+// the inputs of every tick (no frame times, libm calls or global rand()), so
+// two simulations fed the same inputs stay bit-for-bit identical and can run
+// as fast as the cpu allows when nothing has to be rendered.
+class Simulation {
+public:
+	// Ball ids are the entity ids used in snapshots
+	static const int maxBalls = maxEntities;
+	static const int npcBall = 0;
+	
+	Simulation(Kore::u32 seed = 42);
+	
+	// Returns the id of a new player ball or -1 when there is no room
+	int spawnPlayer();
+	// Adds a player ball with a known id and state, for example the one the master spawned for us
+	void place(int ball, const EntityState& state);
+	void remove(int ball);
+	bool isActive(int ball) const;
+	
+	// A tick is beginTick(), movePlayer() for every player that has an input for it and endTick()
+	void beginTick();
+	void movePlayer(int ball, const PlayerInput& input);
+	void endTick();
+	// Sends the falling ball back to the top, for example when somebody caught it
+	void respawnNpc();
+	
+	// State between the previous and the current tick, alpha in [0, 1]
+	EntityState renderState(int ball, float alpha) const;
+	
+	Kore::u32 currentTick() const;
+	// FNV-1a over the whole state, equal checksums mean equal bits
+	Kore::u32 checksum() const;
+	
+	EntityState balls[maxBalls];
+
+private:
+	float random();
+	
+	bool active[maxBalls];
+	EntityState previous[maxBalls];
+	Kore::u32 tickCount;
+	Kore::u32 randomState;
+};
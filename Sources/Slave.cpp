@@ -0,0 +1,187 @@
+#include "pch.h"
+
+#include "Slave.h"
+#include "BitStream.h"
+
+#include <Kore/Log.h>
+#include <algorithm>
+#include <string.h>
+
+using namespace Kore;
+
+namespace {
+	// Balls missing from the snapshots for this long left the interest area
+	const double forgetTime = 1.0;
+	// Snapshots the interpolation delay covers at the current rate, so one lost snapshot is no gap
+	const double bufferedSnapshots = 3;
+	// By then the master dropped us for sure
+	const double rejoinTimeout = clientTimeout + 1.0;
+	
+	// Differs between two connects, and comes out the same when a recording is replayed
+	u32 sessionId(double now) {
+		u64 bits;
+		memcpy(&bits, &now, sizeof(bits));
+		return (u32)bits ^ (u32)(bits >> 32);
+	}
+}
+
+Slave::Slave(Simulation& simulation, double interpolationDelay) : simulation(simulation), buffer(interpolationDelay), ball(-1), connected(false), address(0), port(0), lastHeard(0),
+	interpolationDelay(interpolationDelay), newestTime(-1), snapshotInterval(0), correctionPending(false), correctionTick(0), reportedLateSnapshots(0) {
+	for (int i = 0; i < maxEntities; ++i) lastSeen[i] = -forgetTime;
+	memset(&stats, 0, sizeof(stats));
+}
+
+void Slave::connect(unsigned address, int port, double now) {
+	connected = true;
+	this->address = address;
+	this->port = port;
+	lastHeard = now;
+	
+	// everything from an earlier connect, the master starts over with us as well
+	if (ball >= 0) simulation.remove(ball);
+	ball = -1;
+	connection = Connection();
+	snapshots = SnapshotReceiver();
+	buffer = SnapshotBuffer(interpolationDelay);
+	inputs = InputHistory();
+	for (int i = 0; i < maxEntities; ++i) lastSeen[i] = -forgetTime;
+	newestTime = -1;
+	snapshotInterval = 0;
+	correctionPending = false;
+	reportedLateSnapshots = 0;
+	
+	connection.init(address, port);
+	connection.update(now);
+	u8 data[1 + 4];
+	BitWriter writer(data, sizeof(data));
+	writer.write(Hello, 8);
+	writer.write(sessionId(now), 32);
+	connection.sendReliable(data, writer.bytes());
+}
+
+bool Slave::joined() const {
+	return ball >= 0;
+}
+
+int Slave::ownBall() const {
+	return ball;
+}
+
+void Slave::receiveWelcome(const Message& message) {
+	BitReader reader(&message.data[1], message.size - 1);
+	int id = (int)reader.read(16);
+	QuantizedEntity state;
+	state.x = reader.read(32);
+	state.y = reader.read(32);
+	state.z = reader.read(32);
+	state.rotation = reader.read(32);
+	if (reader.overflowed() || id >= Simulation::maxBalls || ball >= 0) return;
+	ball = id;
+	simulation.place(ball, dequantize(state));
+}
+
+void Slave::receiveSnapshot(const Message& message, double time) {
+	Snapshot snapshot;
+	if (!snapshots.read(&message.data[1], message.size - 1, snapshot)) return;
+	
+	buffer.add(snapshot, time);
+	for (int i = 0; i < snapshot.count; ++i) {
+		lastSeen[snapshot.ids[i]] = std::max(lastSeen[snapshot.ids[i]], snapshot.time);
+	}
+	if (snapshot.time > newestTime) {
+		if (newestTime >= 0) snapshotInterval += (snapshot.time - newestTime - snapshotInterval) * 0.1;
+		newestTime = snapshot.time;
+		buffer.setDelay(std::max(interpolationDelay, snapshotInterval * bufferedSnapshots));
+	}
+	
+	if (ball >= 0 && snapshot.hasProcessedInput && (!correctionPending || snapshot.processedInput > correctionTick)) {
+		for (int i = 0; i < snapshot.count; ++i) {
+			if (snapshot.ids[i] != ball) continue;
+			correctionPending = true;
+			correctionTick = snapshot.processedInput;
+			correction = snapshot.entities[i];
+		}
+	}
+	
+	++stats.snapshots;
+	stats.snapshotBytes += message.size;
+	stats.rawSnapshotBytes += 1 + snapshot.count * 7 * sizeof(float);
+}
+
+void Slave::receive(const Packet& packet) {
+	// nobody else gets to welcome us, send snapshots or acknowledge our packets
+	if (packet.address != address || (int)packet.port != port) return;
+	lastHeard = packet.time;
+	connection.receive(packet);
+	Message message;
+	while (connection.nextMessage(message)) {
+		if (message.size == 0) continue;
+		if (message.data[0] == Welcome) {
+			receiveWelcome(message);
+		}
+		// snapshots arriving before the welcome are kept as well, they are acknowledged already
+		if (message.data[0] == StateSnapshot) {
+			receiveSnapshot(message, packet.time);
+		}
+	}
+}
+
+void Slave::update(double now) {
+	if (connected && now - lastHeard > rejoinTimeout) {
+		// the master dropped us or went away, inputs to it would go nowhere
+		log(Warning, "Lost the master, saying hello again");
+		connect(address, port, now);
+	}
+	connection.update(now);
+	
+	if (!correctionPending) return;
+	correctionPending = false;
+	int replayed = inputs.reconcile(correctionTick, correction, simulation, ball);
+	if (replayed > 0) {
+		++stats.corrections;
+		stats.replayedTicks += replayed;
+	}
+}
+
+void Slave::tick(const PlayerInput& input) {
+	if (ball < 0) return;
+	simulation.beginTick();
+	// the own ball moves right away, the master confirms or corrects it later
+	simulation.movePlayer(ball, input);
+	simulation.endTick();
+	inputs.record(simulation.currentTick(), input, simulation.balls[ball]);
+	
+	u8 data[64];
+	data[0] = (u8)PlayerInputs;
+	int size = inputs.write(&data[1], sizeof(data) - 1);
+	if (size > 0) connection.sendUnreliable(data, 1 + size);
+}
+
+int Slave::remoteBalls(double now, u16* ids, EntityState* states, int capacity) const {
+	const Snapshot* newest = buffer.newest();
+	if (newest == nullptr) return 0;
+	int count = 0;
+	for (int id = 0; id < maxEntities && count < capacity; ++id) {
+		// the own ball is predicted locally
+		if (id == ball || newest->time - lastSeen[id] > forgetTime) continue;
+		if (!buffer.sample((u16)id, now, states[count])) continue;
+		ids[count++] = (u16)id;
+	}
+	return count;
+}
+
+double Slave::remoteTime(double now) const {
+	return buffer.renderTime(now);
+}
+
+NetworkStats Slave::takeStats() {
+	NetworkStats result = stats;
+	result.lateSnapshots = buffer.lateSnapshots() - reportedLateSnapshots;
+	reportedLateSnapshots = buffer.lateSnapshots();
+	result.resentMessages = connection.resentMessages();
+	result.roundTripTime = connection.roundTripTime();
+	result.packetLoss = connection.packetLoss();
+	result.sendRate = snapshotInterval > 0 ? 1.0 / snapshotInterval : 0;
+	memset(&stats, 0, sizeof(stats));
+	return result;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "Connection.h"
+#include "Input.h"
+#include "Protocol.h"
+#include "Simulation.h"
+#include "SnapshotBuffer.h"
+
+// Joins a master, predicts the own ball from the local inputs and shows the
+// other balls from the snapshots the master sends.
+class Slave {
+public:
+	Slave(Simulation& simulation, double interpolationDelay = 0.1);
+	
+	// Says hello, resent until the master acknowledges it. Done again by
+	// update() when the master was not heard from for a while.
+	void connect(unsigned address, int port, double now);
+	// True once the master welcomed us and told us our ball
+	bool joined() const;
+	int ownBall() const;
+	
+	void receive(const Packet& packet);
+	// Call once per frame before ticking, resends and reconciles the prediction
+	void update(double now);
+	void tick(const PlayerInput& input);
+	
+	// The balls of everybody else at the interpolation delay, returns how many
+	int remoteBalls(double now, Kore::u16* ids, EntityState* states, int capacity) const;
+	// Master time the remote balls are shown at
+	double remoteTime(double now) const;
+	
+	NetworkStats takeStats();
+
+private:
+	void receiveWelcome(const Message& message);
+	void receiveSnapshot(const Message& message, double time);
+	
+	Simulation& simulation;
+	Connection connection;
+	SnapshotReceiver snapshots;
+	SnapshotBuffer buffer;
+	InputHistory inputs;
+	int ball;
+	bool connected;
+	unsigned address;
+	int port;
+	double lastHeard;
+	
+	// Snapshots only carry the balls the master thought most important, the
+	// others are shown from older snapshots for a while
+	double lastSeen[maxEntities];
+	// The master lowers the snapshot rate on bad connections, the delay follows
+	double interpolationDelay;
+	double newestTime;
+	double snapshotInterval;
+	
+	// Newest state of the own ball confirmed by the master, reconciled once per frame
+	bool correctionPending;
+	Kore::u32 correctionTick;
+	QuantizedEntity correction;
+	
+	NetworkStats stats;
+	int reportedLateSnapshots;
+};
@@ -0,0 +1,264 @@
+#include "pch.h"
+
+#include "Snapshot.h"
+#include "Sequence.h"
+
+#include <Kore/Math/Core.h>
+#include <math.h>
+
+using namespace Kore;
+
+namespace {
+	// Playfield the balls are clamped to, z is not used but kept within the same precision
+	const float minX = -1.0f, maxX = 1.0f;
+	const float minY = -4.0f, maxY = 4.0f;
+	const float minZ = -1.0f, maxZ = 1.0f;
+	// About a millimeter on every axis
+	const int xBits = 11;
+	const int yBits = 13;
+	const int zBits = 11;
+	
+	const int componentBits = 10;
+	const float componentRange = 0.70710678f; // The three smaller components are within +-1/sqrt(2)
+	
+	const float maxInterpolationDistance = 1.0f;
+	
+	// Position deltas up to this many steps are sent in smallDeltaBits bits
+	const int smallDeltaBits = 6;
+	const int maxSmallDelta = (1 << (smallDeltaBits - 1)) - 1;
+	
+	u32 quantizeFloat(float value, float min, float max, int bits) {
+		if (value < min) value = min;
+		if (value > max) value = max;
+		u32 steps = (1u << bits) - 1;
+		return (u32)((value - min) / (max - min) * steps + 0.5f);
+	}
+	
+	float dequantizeFloat(u32 value, float min, float max, int bits) {
+		u32 steps = (1u << bits) - 1;
+		return min + (max - min) * value / steps;
+	}
+	
+	u32 quantizeRotation(Quaternion rotation) {
+		float components[4] = { rotation.x, rotation.y, rotation.z, rotation.w };
+		float length = sqrtf(components[0] * components[0] + components[1] * components[1] + components[2] * components[2] + components[3] * components[3]);
+		int largest = 0;
+		for (int i = 0; i < 4; ++i) {
+			components[i] /= length;
+			if (fabsf(components[i]) > fabsf(components[largest])) largest = i;
+		}
+		// q and -q are the same rotation, so the largest component can always be positive
+		float sign = components[largest] < 0 ? -1.0f : 1.0f;
+		u32 result = (u32)largest;
+		int shift = 2;
+		for (int i = 0; i < 4; ++i) {
+			if (i == largest) continue;
+			result |= quantizeFloat(components[i] * sign, -componentRange, componentRange, componentBits) << shift;
+			shift += componentBits;
+		}
+		return result;
+	}
+	
+	Quaternion dequantizeRotation(u32 value) {
+		int largest = value & 3;
+		float components[4];
+		float sum = 0;
+		int shift = 2;
+		for (int i = 0; i < 4; ++i) {
+			if (i == largest) continue;
+			components[i] = dequantizeFloat((value >> shift) & ((1u << componentBits) - 1), -componentRange, componentRange, componentBits);
+			sum += components[i] * components[i];
+			shift += componentBits;
+		}
+		components[largest] = sqrtf(sum < 1.0f ? 1.0f - sum : 0.0f);
+		return Quaternion(components[0], components[1], components[2], components[3]);
+	}
+	
+	void writeAxis(BitWriter& writer, u32 value, u32 baseline, int bits) {
+		int delta = (int)value - (int)baseline;
+		bool small = delta >= -maxSmallDelta && delta <= maxSmallDelta;
+		writer.writeBool(small);
+		if (small) writer.write((u32)(delta + maxSmallDelta), smallDeltaBits);
+		else writer.write(value, bits);
+	}
+	
+	u32 readAxis(BitReader& reader, u32 baseline, int bits) {
+		if (reader.readBool()) return (u32)((int)baseline + (int)reader.read(smallDeltaBits) - maxSmallDelta);
+		return reader.read(bits);
+	}
+	
+	void writeEntity(BitWriter& writer, const QuantizedEntity& entity, const QuantizedEntity* baseline) {
+		if (baseline == nullptr) {
+			writer.write(entity.x, xBits);
+			writer.write(entity.y, yBits);
+			writer.write(entity.z, zBits);
+			writer.write(entity.rotation, 32);
+			return;
+		}
+		
+		bool moved = entity.x != baseline->x || entity.y != baseline->y || entity.z != baseline->z;
+		bool rotated = entity.rotation != baseline->rotation;
+		writer.writeBool(moved || rotated);
+		if (!moved && !rotated) return;
+		
+		writer.writeBool(moved);
+		if (moved) {
+			writeAxis(writer, entity.x, baseline->x, xBits);
+			writeAxis(writer, entity.y, baseline->y, yBits);
+			writeAxis(writer, entity.z, baseline->z, zBits);
+		}
+		writer.writeBool(rotated);
+		if (rotated) writer.write(entity.rotation, 32);
+	}
+	
+	void readEntity(BitReader& reader, QuantizedEntity& entity, const QuantizedEntity* baseline) {
+		if (baseline == nullptr) {
+			entity.x = reader.read(xBits);
+			entity.y = reader.read(yBits);
+			entity.z = reader.read(zBits);
+			entity.rotation = reader.read(32);
+			return;
+		}
+		
+		entity = *baseline;
+		if (!reader.readBool()) return;
+		
+		if (reader.readBool()) {
+			entity.x = readAxis(reader, baseline->x, xBits);
+			entity.y = readAxis(reader, baseline->y, yBits);
+			entity.z = readAxis(reader, baseline->z, zBits);
+		}
+		if (reader.readBool()) entity.rotation = reader.read(32);
+	}
+	
+	// Both id lists are ascending, so the baseline is walked along with the snapshot
+	const QuantizedEntity* findBaseline(const Snapshot* baseline, u16 id, int& index) {
+		if (baseline == nullptr) return nullptr;
+		while (index < baseline->count && baseline->ids[index] < id) ++index;
+		if (index < baseline->count && baseline->ids[index] == id) return &baseline->entities[index];
+		return nullptr;
+	}
+}
+
+QuantizedEntity quantize(const EntityState& state) {
+	QuantizedEntity entity;
+	entity.x = quantizeFloat(state.x, minX, maxX, xBits);
+	entity.y = quantizeFloat(state.y, minY, maxY, yBits);
+	entity.z = quantizeFloat(state.z, minZ, maxZ, zBits);
+	entity.rotation = quantizeRotation(state.rotation);
+	return entity;
+}
+
+EntityState dequantize(const QuantizedEntity& entity) {
+	EntityState state;
+	state.x = dequantizeFloat(entity.x, minX, maxX, xBits);
+	state.y = dequantizeFloat(entity.y, minY, maxY, yBits);
+	state.z = dequantizeFloat(entity.z, minZ, maxZ, zBits);
+	state.rotation = dequantizeRotation(entity.rotation);
+	return state;
+}
+
+bool teleported(const EntityState& from, const EntityState& to) {
+	float dx = to.x - from.x, dy = to.y - from.y, dz = to.z - from.z;
+	return dx * dx + dy * dy + dz * dz > maxInterpolationDistance * maxInterpolationDistance;
+}
+
+EntityState interpolate(const EntityState& from, const EntityState& to, float t) {
+	if (teleported(from, to)) return t < 0.5f ? from : to;
+	EntityState state;
+	state.x = from.x + (to.x - from.x) * t;
+	state.y = from.y + (to.y - from.y) * t;
+	state.z = from.z + (to.z - from.z) * t;
+	// Normalized lerp along the shorter arc, close enough to slerp for the small steps between two states
+	const Quaternion& a = from.rotation;
+	const Quaternion& b = to.rotation;
+	float sign = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w < 0 ? -1.0f : 1.0f;
+	Quaternion q(a.x + (b.x * sign - a.x) * t, a.y + (b.y * sign - a.y) * t, a.z + (b.z * sign - a.z) * t, a.w + (b.w * sign - a.w) * t);
+	float length = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+	state.rotation = Quaternion(q.x / length, q.y / length, q.z / length, q.w / length);
+	return state;
+}
+
+SnapshotSender::SnapshotSender() : nextSequence(0), acknowledged(false), lastAcknowledged(0) {}
+
+// Baseline of the next snapshot
+const Snapshot* SnapshotSender::baseline() const {
+	if (acknowledged && (u16)(nextSequence - lastAcknowledged) < snapshotHistorySize) {
+		return &history[lastAcknowledged % snapshotHistorySize];
+	}
+	return nullptr;
+}
+
+int SnapshotSender::write(Snapshot& snapshot, u8* data, int capacity) {
+	const Snapshot* baseline = this->baseline();
+	snapshot.sequence = nextSequence++;
+	history[snapshot.sequence % snapshotHistorySize] = snapshot;
+	
+	BitWriter writer(data, capacity);
+	writer.write(snapshot.sequence, 16);
+	writer.write((u32)(snapshot.time * 1000.0 + 0.5), 32);
+	writer.writeBool(snapshot.hasProcessedInput);
+	if (snapshot.hasProcessedInput) writer.write(snapshot.processedInput, 32);
+	writer.writeBool(baseline != nullptr);
+	if (baseline != nullptr) writer.write(baseline->sequence, 16);
+	writer.write(snapshot.count, snapshotCountBits);
+	
+	int baselineIndex = 0;
+	for (int i = 0; i < snapshot.count; ++i) {
+		writer.write(snapshot.ids[i], entityIdBits);
+		writeEntity(writer, snapshot.entities[i], findBaseline(baseline, snapshot.ids[i], baselineIndex));
+	}
+	return writer.overflowed() ? 0 : writer.bytes();
+}
+
+int SnapshotSender::entityBits(u16 id, const QuantizedEntity& entity) const {
+	u8 data[16];
+	BitWriter writer(data, sizeof(data));
+	int baselineIndex = 0;
+	writeEntity(writer, entity, findBaseline(baseline(), id, baselineIndex));
+	return entityIdBits + writer.bits();
+}
+
+void SnapshotSender::acknowledge(u16 sequence) {
+	// Acks for snapshots that were never sent are ignored
+	if (sequenceGreater(sequence, nextSequence - 1)) return;
+	if (!acknowledged || sequenceGreater(sequence, lastAcknowledged)) {
+		acknowledged = true;
+		lastAcknowledged = sequence;
+	}
+}
+
+SnapshotReceiver::SnapshotReceiver() {
+	for (int i = 0; i < snapshotHistorySize; ++i) received[i] = false;
+}
+
+bool SnapshotReceiver::read(const u8* data, int size, Snapshot& snapshot) {
+	BitReader reader(data, size);
+	snapshot.sequence = (u16)reader.read(16);
+	snapshot.time = reader.read(32) / 1000.0;
+	snapshot.hasProcessedInput = reader.readBool();
+	snapshot.processedInput = snapshot.hasProcessedInput ? reader.read(32) : 0;
+	
+	const Snapshot* baseline = nullptr;
+	if (reader.readBool()) {
+		u16 baselineSequence = (u16)reader.read(16);
+		int slot = baselineSequence % snapshotHistorySize;
+		if (!received[slot] || history[slot].sequence != baselineSequence) return false;
+		baseline = &history[slot];
+	}
+	
+	snapshot.count = (int)reader.read(snapshotCountBits);
+	if (snapshot.count > maxSnapshotEntities) return false;
+	
+	int baselineIndex = 0;
+	for (int i = 0; i < snapshot.count; ++i) {
+		snapshot.ids[i] = (u16)reader.read(entityIdBits);
+		readEntity(reader, snapshot.entities[i], findBaseline(baseline, snapshot.ids[i], baselineIndex));
+	}
+	if (reader.overflowed()) return false;
+	
+	int slot = snapshot.sequence % snapshotHistorySize;
+	history[slot] = snapshot;
+	received[slot] = true;
+	return true;
+}
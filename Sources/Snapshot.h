@@ -0,0 +1,81 @@
+#pragma once
+
+#include <Kore/pch.h>
+#include <Kore/Math/Quaternion.h>
+#include "BitStream.h"
+
+// Entity ids are below maxEntities, a snapshot holds the maxSnapshotEntities most relevant ones
+const int maxEntities = 256;
+const int entityIdBits = 8;
+const int maxSnapshotEntities = 64;
+const int snapshotCountBits = 7;
+
+struct EntityState {
+	float x, y, z;
+	Kore::Quaternion rotation;
+};
+
+// Fixed point position inside the playfield bounds and a smallest-three rotation
+struct QuantizedEntity {
+	Kore::u32 x, y, z;
+	Kore::u32 rotation;
+};
+
+struct Snapshot {
+	Kore::u16 sequence;
+	// Simulation time of the master in seconds, sent with millisecond precision
+	double time;
+	// Newest input of the receiving client that is part of this state
+	bool hasProcessedInput;
+	Kore::u32 processedInput;
+	int count;
+	// Ascending, an entity is only compressed against the baseline entry with the same id
+	Kore::u16 ids[maxSnapshotEntities];
+	QuantizedEntity entities[maxSnapshotEntities];
+};
+
+QuantizedEntity quantize(const EntityState& state);
+EntityState dequantize(const QuantizedEntity& entity);
+
+// Moves further than this between two states (like the npc ball wrapping around) are not interpolated
+bool teleported(const EntityState& from, const EntityState& to);
+// Lerps the position and nlerps the rotation, t in [0, 1]
+EntityState interpolate(const EntityState& from, const EntityState& to, float t);
+
+const int snapshotHistorySize = 32;
+
+// Writes snapshots delta compressed against the newest one the receiver acknowledged
+class SnapshotSender {
+public:
+	// Upper bound of everything in a snapshot but the entities
+	static const int headerBits = 16 + 32 + 1 + 32 + 1 + 16 + snapshotCountBits;
+	
+	SnapshotSender();
+	
+	// Assigns the next sequence number and returns the number of bytes written
+	int write(Snapshot& snapshot, Kore::u8* data, int capacity);
+	void acknowledge(Kore::u16 sequence);
+
+	// Size of the entity in the next snapshot, for packing as many as fit into a budget
+	int entityBits(Kore::u16 id, const QuantizedEntity& entity) const;
+
+private:
+	const Snapshot* baseline() const;
+	
+	Snapshot history[snapshotHistorySize];
+	Kore::u16 nextSequence;
+	bool acknowledged;
+	Kore::u16 lastAcknowledged;
+};
+
+class SnapshotReceiver {
+public:
+	SnapshotReceiver();
+	
+	// Returns false for broken packets and when the baseline is no longer known
+	bool read(const Kore::u8* data, int size, Snapshot& snapshot);
+
+private:
+	Snapshot history[snapshotHistorySize];
+	bool received[snapshotHistorySize];
+};
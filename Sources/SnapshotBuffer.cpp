@@ -0,0 +1,114 @@
+#include "pch.h"
+
+#include "SnapshotBuffer.h"
+#include "Sequence.h"
+
+using namespace Kore;
+
+SnapshotBuffer::SnapshotBuffer(double delay, double maxExtrapolation) : count(0), delay(delay), maxExtrapolation(maxExtrapolation), clockOffset(0), late(0) {}
+
+void SnapshotBuffer::add(const Snapshot& snapshot, double receiveTime) {
+	// The fastest packets tell the clock offset best, slower ones only pull it back slowly
+	double offset = snapshot.time - receiveTime;
+	if (count == 0 || offset > clockOffset) clockOffset = offset;
+	else clockOffset += (offset - clockOffset) * 0.01;
+	
+	if (snapshot.time < receiveTime + clockOffset - delay) ++late;
+	
+	int index = count;
+	while (index > 0 && sequenceGreater(snapshots[index - 1].sequence, snapshot.sequence)) --index;
+	if (index > 0 && snapshots[index - 1].sequence == snapshot.sequence) return;
+	if (count == size) {
+		// Drop the oldest, unless the new one would be the oldest
+		if (index == 0) return;
+		for (int i = 1; i < index; ++i) snapshots[i - 1] = snapshots[i];
+		--index;
+	}
+	else {
+		for (int i = count; i > index; --i) snapshots[i] = snapshots[i - 1];
+		++count;
+	}
+	snapshots[index] = snapshot;
+}
+
+bool SnapshotBuffer::find(int index, u16 id, EntityState& state) const {
+	const Snapshot& snapshot = snapshots[index];
+	for (int i = 0; i < snapshot.count; ++i) {
+		if (snapshot.ids[i] == id) {
+			state = dequantize(snapshot.entities[i]);
+			return true;
+		}
+	}
+	return false;
+}
+
+double SnapshotBuffer::renderTime(double now) const {
+	return now + clockOffset - delay;
+}
+
+bool SnapshotBuffer::sample(u16 id, double now, EntityState& state) const {
+	double renderTime = this->renderTime(now);
+	
+	// Newest snapshot containing the entity at or before the render time and the next one after it
+	int before = -1, after = -1;
+	EntityState from, to;
+	for (int i = count - 1; i >= 0; --i) {
+		EntityState current;
+		if (!find(i, id, current)) continue;
+		if (snapshots[i].time <= renderTime) {
+			before = i;
+			from = current;
+			break;
+		}
+		after = i;
+		to = current;
+	}
+	
+	if (before < 0 && after < 0) return false;
+	
+	if (before < 0) {
+		// Render time is older than everything buffered
+		state = to;
+		return true;
+	}
+	
+	if (after >= 0) {
+		double span = snapshots[after].time - snapshots[before].time;
+		float t = span > 0 ? (float)((renderTime - snapshots[before].time) / span) : 1.0f;
+		state = interpolate(from, to, t);
+		return true;
+	}
+	
+	// Ran out of snapshots, keep moving with the last known velocity for a short while
+	state = from;
+	EntityState previous;
+	int earlier = before - 1;
+	while (earlier >= 0 && !find(earlier, id, previous)) --earlier;
+	if (earlier < 0 || teleported(previous, from)) return true;
+	
+	double span = snapshots[before].time - snapshots[earlier].time;
+	if (span <= 0) return true;
+	double ahead = renderTime - snapshots[before].time;
+	if (ahead > maxExtrapolation) ahead = maxExtrapolation;
+	float t = (float)(ahead / span);
+	state.x = from.x + (from.x - previous.x) * t;
+	state.y = from.y + (from.y - previous.y) * t;
+	state.z = from.z + (from.z - previous.z) * t;
+	return true;
+}
+
+const Snapshot* SnapshotBuffer::newest() const {
+	return count > 0 ? &snapshots[count - 1] : nullptr;
+}
+
+void SnapshotBuffer::setDelay(double delay) {
+	this->delay = delay;
+}
+
+double SnapshotBuffer::getDelay() const {
+	return delay;
+}
+
+int SnapshotBuffer::lateSnapshots() const {
+	return late;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Snapshot.h"
+
+// Jitter buffer for received snapshots. Entities are sampled at a fixed delay
+// behind the master clock, so there usually are two snapshots to interpolate
+// between even when packets arrive late, out of order or not at all.
+class SnapshotBuffer {
+public:
+	SnapshotBuffer(double delay = 0.1, double maxExtrapolation = 0.25);
+	
+	// Out of order snapshots are sorted in, duplicates and very old ones are dropped
+	void add(const Snapshot& snapshot, double receiveTime);
+	
+	// Returns false as long as nothing is known about the entity
+	bool sample(Kore::u16 id, double now, EntityState& state) const;
+	// Master time sample() shows at the local time
+	double renderTime(double now) const;
+	
+	// Nullptr while empty
+	const Snapshot* newest() const;
+	
+	void setDelay(double delay);
+	double getDelay() const;
+	
+	// Snapshots that arrived after already being behind the render time
+	int lateSnapshots() const;
+
+private:
+	static const int size = 16;
+	
+	bool find(int index, Kore::u16 id, EntityState& state) const;
+	
+	Snapshot snapshots[size];
+	int count;
+	double delay;
+	double maxExtrapolation;
+	// Smoothed difference between the master clock and the local clock
+	double clockOffset;
+	int late;
+};
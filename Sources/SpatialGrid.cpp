@@ -0,0 +1,70 @@
+#include "pch.h"
+
+#include "SpatialGrid.h"
+
+#include <assert.h>
+
+using namespace Kore;
+
+SpatialGrid::SpatialGrid(float minX, float minY, float maxX, float maxY, float cellSize) : minX(minX), minY(minY), cellSize(cellSize) {
+	columns = (int)((maxX - minX) / cellSize) + 1;
+	rows = (int)((maxY - minY) / cellSize) + 1;
+	assert(columns * rows <= maxCells);
+	for (int i = 0; i <= maxCells; ++i) cellStart[i] = 0;
+}
+
+int SpatialGrid::cell(float x, float y) const {
+	int column = (int)((x - minX) / cellSize);
+	int row = (int)((y - minY) / cellSize);
+	if (column < 0) column = 0;
+	if (column >= columns) column = columns - 1;
+	if (row < 0) row = 0;
+	if (row >= rows) row = rows - 1;
+	return row * columns + column;
+}
+
+// Counting sort by cell, two passes over the balls and no allocations
+void SpatialGrid::build(const Simulation& simulation) {
+	int cellCount = columns * rows;
+	int counts[maxCells];
+	for (int i = 0; i < cellCount; ++i) counts[i] = 0;
+	for (int i = 0; i < Simulation::maxBalls; ++i) {
+		if (simulation.isActive(i)) ++counts[cell(simulation.balls[i].x, simulation.balls[i].y)];
+	}
+	
+	cellStart[0] = 0;
+	for (int i = 0; i < cellCount; ++i) {
+		cellStart[i + 1] = cellStart[i] + counts[i];
+		counts[i] = cellStart[i];
+	}
+	
+	for (int i = 0; i < Simulation::maxBalls; ++i) {
+		if (!simulation.isActive(i)) continue;
+		const EntityState& ball = simulation.balls[i];
+		int index = counts[cell(ball.x, ball.y)]++;
+		entries[index] = (u16)i;
+		entryX[index] = ball.x;
+		entryY[index] = ball.y;
+	}
+}
+
+int SpatialGrid::query(float x, float y, float radius, u16* ids, int capacity) const {
+	int first = cell(x - radius, y - radius);
+	int last = cell(x + radius, y + radius);
+	int firstColumn = first % columns, firstRow = first / columns;
+	int lastColumn = last % columns, lastRow = last / columns;
+	
+	int count = 0;
+	for (int row = firstRow; row <= lastRow; ++row) {
+		for (int column = firstColumn; column <= lastColumn; ++column) {
+			int index = row * columns + column;
+			for (int i = cellStart[index]; i < cellStart[index + 1]; ++i) {
+				float dx = entryX[i] - x, dy = entryY[i] - y;
+				if (dx * dx + dy * dy > radius * radius) continue;
+				if (count == capacity) return count;
+				ids[count++] = entries[i];
+			}
+		}
+	}
+	return count;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "Simulation.h"
+
+// Uniform grid over the playfield, rebuilt from scratch whenever the balls
+// moved. Answers which balls are within a radius by only looking at the
+// cells the radius touches.
+class SpatialGrid {
+public:
+	SpatialGrid(float minX, float minY, float maxX, float maxY, float cellSize);
+	
+	void build(const Simulation& simulation);
+	
+	// Writes the ids of the balls within the radius, returns how many
+	int query(float x, float y, float radius, Kore::u16* ids, int capacity) const;
+
+private:
+	static const int maxCells = 1024;
+	
+	int cell(float x, float y) const;
+	
+	float minX, minY;
+	float cellSize;
+	int columns, rows;
+	// Balls sorted by cell, the balls of cell i are entries[cellStart[i]] to entries[cellStart[i + 1] - 1]
+	int cellStart[maxCells + 1];
+	Kore::u16 entries[Simulation::maxBalls];
+	float entryX[Simulation::maxBalls];
+	float entryY[Simulation::maxBalls];
+};
@@ -3,10 +3,11 @@
 in vec3 pos;
 in vec2 tex;
 in vec3 nor;
+// per instance
+in mat4 M;
 out vec2 texCoord;
 out vec3 normal;
 uniform mat4 PV;
-uniform mat4 M;
 
 void main() {
 	gl_Position = PV * M * vec4(pos.x, pos.y, pos.z, 1.0);